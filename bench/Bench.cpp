@@ -0,0 +1,157 @@
+#include "Bench.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "NeutOsc.h"
+#include "AllocCounter.h"
+#include "Parallel.h"
+
+namespace bench {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+volatile double sinkValue = 0;
+
+double secondsFor(const Benchmark& b, const long calls) {
+  const Clock::time_point start = Clock::now();
+  for(long c = 0; c < calls; ++c) b.fn();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Time a benchmark: find a number of calls that takes at least minTime per
+// repetition, then report the median and fastest of reps repetitions.
+Result run(const Benchmark& b, const double minTime, const int reps) {
+  b.fn(); // Warm up caches and lazily built state.
+  long calls = 1;
+  double secs = secondsFor(b, calls);
+  while(secs < minTime) {
+    calls = secs > 0? std::max(calls*2, (long)(calls*minTime/secs*1.2)): calls*10;
+    secs = secondsFor(b, calls);
+  }
+
+  std::vector<double> times(reps);
+  // Over all threads, for the benchmarks that spread their work.
+  const uint64_t allocs0 = neutosc::totalAllocs, bytes0 = neutosc::totalAllocBytes;
+  for(int r = 0; r < reps; ++r) times[r] = secondsFor(b, calls);
+  const double allocs = neutosc::totalAllocs - allocs0, bytes = neutosc::totalAllocBytes - bytes0;
+  const double totalcalls = (double)calls*reps;
+  Result res;
+  res.name = b.name;
+  res.samples = b.samples;
+  res.calls = calls;
+  res.allocsPerCall = allocs/totalcalls;
+  res.bytesPerCall = bytes/totalcalls;
+  std::sort(times.begin(), times.end());
+  const double scale = 1e9/((double)calls*b.samples);
+  res.nsPerSample = times[reps/2]*scale;
+  res.nsPerSampleMin = times[0]*scale;
+  return res;
+} // run()
+
+std::string quoted(const std::string& str) {
+  std::string res = "\"";
+  for(const char c : str) {
+    if(c == '"' || c == '\\') res.push_back('\\');
+    res.push_back(c);
+  }
+  return res + "\"";
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results, const double minTime, const int reps) {
+  out << "{\n  \"context\": {\n"
+      << "    \"vacuum_kernel\": " << quoted(neutosc::vacuumKernelName()) << ",\n"
+#if defined(__VERSION__)
+      << "    \"compiler\": " << quoted(__VERSION__) << ",\n"
+#endif
+#ifdef NDEBUG
+      << "    \"assertions\": false,\n"
+#else
+      << "    \"assertions\": true,\n"
+#endif
+      << "    \"hardware_threads\": " << neutosc::numWorkers() << ",\n"
+      << "    \"min_time_s\": " << minTime << ",\n"
+      << "    \"repetitions\": " << reps << "\n"
+      << "  },\n  \"benchmarks\": [\n";
+  for(size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << "    {\"name\": " << quoted(r.name)
+        << ", \"samples_per_call\": " << r.samples
+        << ", \"calls\": " << r.calls
+        << ", \"ns_per_sample\": " << r.nsPerSample
+        << ", \"ns_per_sample_min\": " << r.nsPerSampleMin
+        << ", \"allocs_per_call\": " << r.allocsPerCall
+        << ", \"bytes_per_call\": " << r.bytesPerCall << "}"
+        << (i+1 < results.size()? ",\n": "\n");
+  }
+  out << "  ]\n}\n";
+} // writeJson()
+
+} // namespace
+
+void sink(const double val) { sinkValue = sinkValue + val; }
+
+} // namespace bench
+
+int main(int argc, char* argv[]) {
+  std::string filter, outname;
+  double minTime = 0.05;
+  int reps = 5;
+  bool list = false;
+  for(int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if(i+1 < argc && arg == "--filter") filter = argv[++i];
+    else if(i+1 < argc && arg == "--out") outname = argv[++i];
+    else if(i+1 < argc && arg == "--min-time") minTime = std::atof(argv[++i]);
+    else if(i+1 < argc && arg == "--reps") reps = std::max(1, std::atoi(argv[++i]));
+    else if(arg == "--list") list = true;
+    else {
+      // Asking for help is a success, anything else unknown is an error.
+      const bool help = arg == "--help" || arg == "-h";
+      if(!help) std::cerr << "Unknown option or missing value: " << arg << "\n";
+      (help? std::cout: std::cerr) << "Usage: " << argv[0] << " [--filter substring] [--out file.json]"
+                                   << " [--min-time seconds] [--reps n] [--list]\n";
+      return help? 0: 1;
+    }
+  }
+
+  bench::Suite suite;
+  bench::addPhysics(suite);
+#ifdef BENCH_GEOMETRY
+  bench::addGeometry(suite);
+#endif
+
+  std::vector<bench::Result> results;
+  for(const bench::Benchmark& b : suite.getBenchmarks()) {
+    if(list) {
+      std::cout << b.name << '\n';
+      continue;
+    }
+    if(!filter.empty() && b.name.find(filter) == std::string::npos) continue;
+    results.push_back(bench::run(b, minTime, reps));
+    const bench::Result& r = results.back();
+    std::cerr << r.name << ": " << r.nsPerSample << " ns/sample, "
+              << r.allocsPerCall << " allocs/call\n";
+  }
+  if(list) return 0;
+
+  if(outname.empty()) {
+    bench::writeJson(std::cout, results, minTime, reps);
+  } else {
+    std::ofstream ofile(outname);
+    if(!ofile.is_open()) {
+      std::cerr << "Couldn't create file " << outname << ".\n";
+      return 1;
+    }
+    bench::writeJson(ofile, results, minTime, reps);
+  }
+  return 0;
+}
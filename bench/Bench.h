@@ -0,0 +1,49 @@
+#ifndef BENCH_H__
+#define BENCH_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+namespace bench {
+
+// A benchmark is a function that does 'samples' units of work per call,
+// e.g. one probability or one vertex each.
+struct Benchmark {
+  std::string name;
+  size_t samples;
+  std::function<void()> fn;
+};
+
+struct Result {
+  std::string name;
+  size_t samples; // Per call.
+  long calls; // Per repetition.
+  double nsPerSample; // Median over repetitions.
+  double nsPerSampleMin;
+  double allocsPerCall;
+  double bytesPerCall;
+};
+
+class Suite {
+  private:
+  std::vector<Benchmark> benchmarks;
+
+  public:
+  void add(const std::string& name, const size_t samples, std::function<void()> fn) {
+    benchmarks.push_back(Benchmark{name, samples, fn});
+  }
+  const std::vector<Benchmark>& getBenchmarks() const { return benchmarks; }
+}; // class Suite
+
+// Keep the compiler from optimising away a computed value.
+void sink(const double val);
+
+// Defined by each group of benchmarks.
+void addPhysics(Suite& suite);
+void addGeometry(Suite& suite);
+
+} // namespace bench
+
+#endif
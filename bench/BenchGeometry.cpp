@@ -0,0 +1,53 @@
+#include "Bench.h"
+#include <memory>
+#include <random>
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+
+#include "DrawUtil.h"
+
+namespace bench {
+
+namespace {
+
+// A wiggly path through the probability triangle, like a long oscillation path.
+// Seeded so that every run draws the same path.
+std::vector<Eigen::Vector3f> syntheticPath(const int n) {
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<float> jitter(0, 0.05f);
+  std::vector<Eigen::Vector3f> path(n);
+  for(int i = 0; i < n; ++i) {
+    const float t = 0.01f*i;
+    Eigen::Vector3f p(1.2f + std::sin(t) + jitter(rng), 1.2f + std::sin(1.7f*t) + jitter(rng),
+                      1.2f + std::sin(2.3f*t) + jitter(rng));
+    path[i] = p/p.sum();
+  }
+  return path;
+}
+
+} // namespace
+
+void addGeometry(Suite& suite) {
+  const sf::Vector2f top(1000, 100), left(500, 966), right(1500, 966);
+  for(const int n : {1500, 10000}) {
+    std::shared_ptr<std::vector<Eigen::Vector3f>> path(new std::vector<Eigen::Vector3f>(syntheticPath(n)));
+    std::shared_ptr<std::vector<sf::Vertex>> vertices(new std::vector<sf::Vertex>(n));
+    for(int i = 0; i < n; ++i) {
+      (*vertices)[i] = left + (*path)[i](0)*(top-left) + (*path)[i](1)*(right-left);
+    }
+    suite.add("DrawUtil::TriStrip/" + std::to_string(n), n, [vertices] {
+      sink(DrawUtil::TriStrip(*vertices, 6)[0].position.x);
+    });
+
+    // The CPU work of TernaryGraph::addDrawing, before the upload to vertex buffers.
+    std::shared_ptr<std::vector<sf::Vertex>> drawing(new std::vector<sf::Vertex>);
+    std::shared_ptr<std::vector<sf::Vertex>> highlight(new std::vector<sf::Vertex>);
+    suite.add("TernaryGraph::addDrawing/" + std::to_string(n), n, [=] {
+      DrawUtil::PathStrips(*path, top, left, right, *drawing, *highlight);
+      sink((*drawing)[0].position.x);
+    });
+  }
+} // addGeometry()
+
+} // namespace bench
@@ -0,0 +1,211 @@
+#include "Bench.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "NeutOsc.h"
+#include "EarthModel.h"
+#include "Oscillogram.h"
+#include "Heatmap.h"
+#include "Fit.h"
+
+namespace bench {
+
+namespace {
+
+// Default parameters with an initial muon neutrino over a typical long baseline.
+template<typename Scalar>
+std::shared_ptr<neutosc::BasicOscillator<Scalar>> makeOscillator(const double rho) {
+  std::shared_ptr<neutosc::BasicOscillator<Scalar>> osc(new neutosc::BasicOscillator<Scalar>);
+  osc->pars().nu = 1;
+  osc->pars().E = 2;
+  osc->pars().L = 1300;
+  osc->pars().rho = rho;
+  osc->update();
+  return osc;
+}
+
+std::string rhoName(const double rho) {
+  return "rho=" + std::to_string((int)rho);
+}
+
+} // namespace
+
+void addPhysics(Suite& suite) {
+  {
+    std::shared_ptr<neutosc::Oscillator> osc = makeOscillator<double>(2848);
+    suite.add("Oscillator::update", 1, [osc] { osc->update(); });
+  }
+  {
+    std::shared_ptr<neutosc::Oscillator> osc = makeOscillator<double>(0);
+    suite.add("Oscillator::transvac", 1, [osc] { sink(osc->transvac()(0)); });
+  }
+  for(const double rho : {1000., 2848., 12894.}) {
+    std::shared_ptr<neutosc::Oscillator> osc = makeOscillator<double>(rho);
+    suite.add("Oscillator::transmat/" + rhoName(rho), 1, [osc] { sink(osc->transmat()(0)); });
+    suite.add("Oscillator::transmatexp/" + rhoName(rho), 1, [osc] { sink(osc->transmatexp()(0)); });
+    // The eigensystem is cached per energy, as in a sweep over L.
+    suite.add("Oscillator::transmateig/" + rhoName(rho), 1, [osc] { sink(osc->transmateig()(0)); });
+  }
+
+  // Full sweeps over L, as drawn on screen (float) and exported (double).
+  for(const int steps : {1500, 10000}) {
+    for(const double rho : {0., 2848.}) {
+      const std::string suffix = "/" + std::to_string(steps) + "/" + rhoName(rho);
+      std::shared_ptr<neutosc::Oscillator> osc = makeOscillator<double>(rho);
+      suite.add("oscillate<double>" + suffix, steps+1, [osc, steps] {
+        sink(neutosc::oscillate(*osc, osc->pars().L, steps).back()(0));
+      });
+      std::shared_ptr<neutosc::OscillatorF> fosc = makeOscillator<float>(rho);
+      suite.add("oscillate<float>" + suffix, steps+1, [fosc, steps] {
+        sink(neutosc::oscillate(*fosc, fosc->pars().L, steps).back()(0));
+      });
+    }
+  }
+
+  // The on-screen sweep smeared over a 5% Gaussian resolution, one evaluation per point,
+  // and averaged over a beam spectrum from 0.5 to 5 GeV, one per point and energy cell.
+  {
+    std::shared_ptr<neutosc::FluxSpectrum> flux(new neutosc::FluxSpectrum);
+    for(int i = 0; i <= 9; ++i) {
+      flux->E.push_back(0.5 + 0.5*i);
+      flux->flux.push_back(std::exp(-(flux->E.back() - 2.5)*(flux->E.back() - 2.5)));
+    }
+    neutosc::Smearing gauss;
+    gauss.width = 0.05;
+    neutosc::Smearing beam;
+    beam.flux = flux;
+    const int steps = 1500;
+    for(const double rho : {0., 2848.}) {
+      const std::string suffix = "/" + std::to_string(steps) + "/" + rhoName(rho);
+      std::shared_ptr<neutosc::OscillatorF> fosc = makeOscillator<float>(rho);
+      suite.add("oscillateSmeared<float>/gauss" + suffix, steps+1, [fosc, gauss, steps] {
+        sink(neutosc::oscillate(*fosc, fosc->pars().L, steps, neutosc::Engine::EigenDecomp, gauss).back()(0));
+      });
+      suite.add("oscillateSmeared<float>/flux" + suffix, steps+1, [fosc, beam, steps] {
+        sink(neutosc::oscillate(*fosc, fosc->pars().L, steps, neutosc::Engine::EigenDecomp, beam).back()(0));
+      });
+    }
+  }
+
+  // Atmospheric zenith scans through the PREM Earth, as the viewer and headless exports do
+  // them: with the shell eigensystems cached for the energy, and recomputed first.
+  {
+    const int steps = 1000;
+    std::shared_ptr<neutosc::Oscillator> osc = makeOscillator<double>(0);
+    std::shared_ptr<neutosc::EarthPropagator> earth(new neutosc::EarthPropagator(*osc));
+    std::shared_ptr<std::vector<double>> cosz(new std::vector<double>(steps+1));
+    for(int i = 0; i <= steps; ++i) (*cosz)[i] = -1 + 2.*i/steps;
+    std::shared_ptr<std::vector<Eigen::Vector3d>> probs(new std::vector<Eigen::Vector3d>(steps+1));
+    const std::string suffix = "/" + std::to_string(steps);
+    suite.add("EarthPropagator::zenithBatch" + suffix, steps+1, [osc, earth, cosz, probs] {
+      earth->zenithBatch(cosz->data(), cosz->size(), probs->data());
+      sink(probs->front()(0));
+    });
+    suite.add("EarthPropagator::zenithBatch/update" + suffix, steps+1, [osc, earth, cosz, probs] {
+      osc->update();
+      earth->zenithBatch(cosz->data(), cosz->size(), probs->data());
+      sink(probs->front()(0));
+    });
+  }
+
+  // Oscillograms of E by L and by cos(zenith) through the Earth, over all cores.
+  for(const neutosc::Axis axis : {neutosc::Axis::L, neutosc::Axis::CosZenith}) {
+    neutosc::OscillogramGrid grid;
+    grid.nE = grid.nY = 500;
+    grid.axis = axis;
+    if(axis == neutosc::Axis::CosZenith) {
+      grid.ymin = -1;
+      grid.ymax = 1;
+    }
+    std::shared_ptr<neutosc::Oscillator> osc = makeOscillator<double>(2848);
+    std::shared_ptr<neutosc::Oscillogram> gram(new neutosc::Oscillogram(grid));
+    const std::string name = axis == neutosc::Axis::L? "L": "cosz";
+    suite.add("Oscillogram::compute/" + name + "/500x500", grid.size(), [osc, gram] {
+      gram->compute(*osc);
+      sink(gram->data().back()(0));
+    });
+  }
+
+  // Probabilities with their derivatives by the six mixing parameters, in one analytic
+  // pass against forward finite differences, which take seven sweeps.
+  for(const double rho : {0., 2848.}) {
+    std::shared_ptr<neutosc::Oscillator> osc = makeOscillator<double>(rho);
+    suite.add("Oscillator::transJacobian/" + rhoName(rho), 1, [osc] {
+      neutosc::Oscillator::Jacobian J;
+      sink(osc->transJacobian(J)(0) + J(0,5));
+    });
+
+    const int steps = 1000;
+    const std::string suffix = "/" + std::to_string(steps) + "/" + rhoName(rho);
+    std::shared_ptr<std::vector<double>> xs(new std::vector<double>(steps+1));
+    for(int i = 0; i <= steps; ++i) (*xs)[i] = osc->pars().L*i/steps;
+    std::shared_ptr<std::vector<neutosc::Oscillator::Vector3>> probs(
+        new std::vector<neutosc::Oscillator::Vector3>(steps+1));
+    std::shared_ptr<std::vector<neutosc::Oscillator::Jacobian>> jacs(
+        new std::vector<neutosc::Oscillator::Jacobian>(steps+1));
+    suite.add("Oscillator::transJacobianBatch" + suffix, steps+1, [osc, xs, probs, jacs] {
+      osc->transJacobianBatch(xs->data(), xs->size(), &neutosc::OscPars::L, probs->data(), jacs->data());
+      sink(jacs->back()(0,5));
+    });
+    suite.add("finiteDifferenceJacobian" + suffix, steps+1, [osc, steps] {
+      const std::vector<neutosc::Oscillator::Vector3> base = neutosc::oscillate(*osc, osc->pars().L, steps);
+      double sum = 0;
+      for(double neutosc::OscPars::* which : neutosc::jacobianPars()) {
+        const double initial = osc->pars().*which;
+        const double h = 1e-6*(initial != 0? std::abs(initial): 1);
+        osc->pars().*which = initial + h;
+        const std::vector<neutosc::Oscillator::Vector3> shifted = neutosc::oscillate(*osc, osc->pars().L, steps);
+        osc->pars().*which = initial;
+        sum += (shifted.back()(0) - base.back()(0))/h;
+      }
+      osc->update();
+      sink(sum);
+    });
+  }
+
+  // Fits of th23, dCP and Dm31sq to a spectrum made from the default parameters, as
+  // appearance and disappearance of neutrinos and antineutrinos from 0.5 to 5 GeV, from
+  // a start that's off by about the current uncertainties.
+  for(const int numbins : {100, 400}) {
+    std::shared_ptr<neutosc::Spectrum> data(new neutosc::Spectrum);
+    neutosc::Oscillator osc;
+    osc.pars().nu = 1;
+    osc.pars().L = 1300;
+    osc.pars().rho = 2848;
+    const int perchannel = numbins/4;
+    for(int ci = 0; ci < 4; ++ci) {
+      osc.pars().anti = ci >= 2;
+      osc.update();
+      for(int bi = 0; bi < perchannel; ++bi) {
+        neutosc::SpectrumBin bin{0.5 + 4.5*bi/perchannel, 0.5 + 4.5*(bi+1)/perchannel, osc.pars().L, 1, ci%2 == 0? 0: 1,
+                                 osc.pars().anti, 0, 0.01};
+        osc.pars().E = (bin.Emin + bin.Emax)/2;
+        bin.value = osc.trans()(bin.final);
+        data->bins.push_back(bin);
+      }
+    }
+    neutosc::OscPars start = osc.pars();
+    start.th23 += 0.02;
+    start.dCP += 0.3;
+    start.Dm31sq *= 1.02;
+    suite.add("fitSpectrum/" + std::to_string(numbins), 1, [data, start] {
+      sink(neutosc::fitSpectrum(*data, start).chi2);
+    });
+  }
+
+  // Binning a long sweep into the heatmap histogram, over all cores.
+  for(const double rho : {0., 2848.}) {
+    const size_t points = 1000000;
+    std::shared_ptr<neutosc::OscillatorF> fosc = makeOscillator<float>(rho);
+    fosc->pars().L = 1e5;
+    std::shared_ptr<neutosc::TernaryHistogram> hist(new neutosc::TernaryHistogram);
+    suite.add("TernaryHistogram::accumulate/" + rhoName(rho), points, [fosc, hist, points] {
+      hist->accumulate(*fosc, &neutosc::OscPars::L, fosc->pars().L, points);
+      sink((double)hist->numPoints());
+    });
+  }
+} // addPhysics()
+
+} // namespace bench
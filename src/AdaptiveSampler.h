@@ -0,0 +1,198 @@
+#ifndef ADAPTIVESAMPLER_H__
+#define ADAPTIVESAMPLER_H__
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <functional>
+#include <Eigen/Dense>
+
+#include "NeutOsc.h"
+
+namespace neutosc {
+
+struct AdaptiveOptions {
+  // Largest allowed distance, in probability, of an interval's midpoint from the
+  // straight line between its ends. The ternary plot is a linear map of the
+  // probabilities, so this bounds how far the drawn line is from the curve.
+  double tolerance = 1e-3;
+  // Largest allowed probability change between neighbouring points. Catches fast
+  // oscillations whose midpoint happens to land near the straight line.
+  double maxChange = 0.1;
+  // Hard limit on the number of points returned.
+  size_t maxPoints = 1500;
+  // Least number of evenly spaced points to start refining from. Sweeps over L or rho
+  // start from more if needed to put several on every period of the fastest phase.
+  size_t initialPoints = 65;
+  // Called after each round of new points with the number evaluated so far and the
+  // budget. Sampling stops where it is if it returns false.
+  std::function<bool(size_t, size_t)> progress;
+};
+
+// Points and probabilities from the adaptive sampler, in order of x.
+template<typename Scalar>
+struct SampledPath {
+  std::vector<double> x;
+  std::vector<typename BasicOscillator<Scalar>::Vector3> probs;
+  double maxError = 0; // Largest midpoint distance left when sampling stopped.
+  // False if the point budget ran out before the tolerance was met. The points are
+  // then spaced evenly over the whole budget instead.
+  bool converged = true;
+};
+
+// Number of periods of the fastest oscillation phase in a sweep of L or rho from 0 to
+// final, 0 for other parameters. Matter moves the eigenvalues apart by at most the potential.
+template<typename Scalar>
+double numPeriods(const BasicOscillator<Scalar>& osc, double OscPars::* which, const double final) {
+  const OscPars& p = osc.pars();
+  const double conv = 2.534, pi = 3.14159265358979323846;
+  const double dm = std::max({std::abs(p.Dm21sq), std::abs(p.Dm31sq), std::abs(p.Dm31sq - p.Dm21sq)});
+  double phase = 0;
+  if(which == &OscPars::L) phase = (conv*dm/p.E + std::abs((double)osc.potential(p.rho)))*std::abs(final);
+  else if(which == &OscPars::rho) phase = std::abs((double)osc.potential(final))*p.L;
+  return phase/(2*pi);
+} // numPeriods()
+
+// Sample the probabilities vs one parameter from 0 to final. Starts from an even grid
+// and keeps splitting the intervals that are furthest out of tolerance, worst first,
+// until every interval is within tolerance or the point budget is spent. Each round
+// of new midpoints is evaluated with one transBatch() call. If the budget runs out
+// first, the refined points can be further off than even ones, so the sweep is
+// evaluated again on an even grid of the whole budget.
+template<typename Scalar>
+SampledPath<Scalar> sampleAdaptive(BasicOscillator<Scalar>& osc, double OscPars::* which, const double final,
+                                   const AdaptiveOptions& opts = AdaptiveOptions(),
+                                   const Engine engine = Engine::EigenDecomp,
+                                   const Smearing& smearing = Smearing()) {
+  PROFILE_SCOPE("sampleAdaptive");
+  typedef typename BasicOscillator<Scalar>::Vector3 Vector3;
+  // An interval is three evaluated points: its ends and its midpoint.
+  struct Interval {
+    size_t a, m, b;
+    double err; // Midpoint distance from the chord.
+    double priority; // Worst of the two criteria relative to its limit.
+  };
+
+  std::vector<double> xs;
+  std::vector<Vector3> ps;
+  auto evaluate = [&](const size_t from) {
+    ps.resize(xs.size());
+    osc.transBatch(xs.data() + from, xs.size() - from, which, ps.data() + from, engine, smearing);
+  };
+  auto measure = [&](Interval& in) {
+    const Eigen::Vector3d pa = ps[in.a].template cast<double>();
+    const Eigen::Vector3d pm = ps[in.m].template cast<double>();
+    const Eigen::Vector3d pb = ps[in.b].template cast<double>();
+    in.err = (pm - 0.5*(pa + pb)).cwiseAbs().maxCoeff();
+    const double change = std::max((pm - pa).cwiseAbs().maxCoeff(), (pb - pm).cwiseAbs().maxCoeff());
+    in.priority = std::max(in.err/opts.tolerance, change/opts.maxChange);
+    // A singular end, like E = 0, gives NaN. Splitting towards it never gets anywhere,
+    // and NaN would break the ordering below, so such an interval is left as it is.
+    if(!std::isfinite(in.priority)) {
+      in.err = 0;
+      in.priority = 0;
+    }
+  };
+
+  // Even starting grid with an odd number of points, so that it splits into intervals,
+  // and at least eight on each period of the fastest phase, so none falls between them.
+  const size_t budget = std::max<size_t>(opts.maxPoints, 3);
+  const double periodpoints = std::min(8*numPeriods(osc, which, final) + 1, (double)budget);
+  const size_t initial = std::max(opts.initialPoints, (size_t)periodpoints);
+  const size_t numinitial = std::max<size_t>(1, (std::min(initial, budget) - 1)/2);
+  xs.resize(2*numinitial + 1);
+  for(size_t i = 0; i < xs.size(); ++i) xs[i] = final*i/(xs.size() - 1);
+  evaluate(0);
+  std::vector<Interval> active(numinitial);
+  for(size_t ii = 0; ii < numinitial; ++ii) {
+    active[ii] = Interval{2*ii, 2*ii + 1, 2*ii + 2, 0, 0};
+    measure(active[ii]);
+  }
+
+  SampledPath<Scalar> result;
+  const double minwidth = std::abs(final)*1e-12;
+  std::vector<Interval> done, next;
+  bool cancelled = false;
+  while(!active.empty()) {
+    // Intervals within tolerance, or too narrow to split, are finished.
+    next.clear();
+    for(const Interval& in : active) {
+      if(in.priority <= 1 || std::abs(xs[in.b] - xs[in.a]) <= minwidth) {
+        done.push_back(in);
+      } else {
+        next.push_back(in);
+      }
+    }
+    // Split the worst ones first, as many as the budget allows. Each split adds two midpoints.
+    std::sort(next.begin(), next.end(),
+              [](const Interval& l, const Interval& r) { return l.priority > r.priority; });
+    const size_t numsplit = std::min(next.size(), (budget - xs.size())/2);
+    if(numsplit < next.size()) result.converged = false;
+    done.insert(done.end(), next.begin() + numsplit, next.end());
+    next.resize(numsplit);
+
+    active.clear();
+    const size_t from = xs.size();
+    for(const Interval& in : next) {
+      xs.push_back(0.5*(xs[in.a] + xs[in.m]));
+      active.push_back(Interval{in.a, xs.size() - 1, in.m, 0, 0});
+      xs.push_back(0.5*(xs[in.m] + xs[in.b]));
+      active.push_back(Interval{in.m, xs.size() - 1, in.b, 0, 0});
+    }
+    if(active.empty()) break;
+    evaluate(from);
+    for(Interval& in : active) measure(in);
+    if(opts.progress && !opts.progress(xs.size(), budget)) {
+      done.insert(done.end(), active.begin(), active.end());
+      result.converged = false;
+      cancelled = true;
+      break;
+    }
+  }
+
+  if(!result.converged && !cancelled) {
+    // Out of budget: evenly spaced points instead, with the error estimated from the
+    // midpoints of pairs of neighbouring intervals.
+    xs.resize(budget);
+    for(size_t i = 0; i < budget; ++i) xs[i] = final*i/(budget - 1);
+    evaluate(0);
+    result.x = xs;
+    result.probs = ps;
+    for(size_t i = 1; i+1 < budget; i += 2) {
+      Interval in{i-1, i, i+1, 0, 0};
+      measure(in);
+      result.maxError = std::max(result.maxError, in.err);
+    }
+    return result;
+  }
+
+  // Put the points in order.
+  std::vector<size_t> order(xs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&xs](const size_t l, const size_t r) { return xs[l] < xs[r]; });
+  result.x.resize(xs.size());
+  result.probs.resize(xs.size());
+  for(size_t i = 0; i < order.size(); ++i) {
+    result.x[i] = xs[order[i]];
+    result.probs[i] = ps[order[i]];
+  }
+  for(const Interval& in : done) result.maxError = std::max(result.maxError, in.err);
+  return result;
+} // sampleAdaptive()
+
+// Adaptive version of oscillate(), for a parameter of the oscillator itself.
+template<typename Scalar>
+std::vector<typename BasicOscillator<Scalar>::Vector3> oscillateAdaptive(BasicOscillator<Scalar>& osc, double& par,
+                                                                         const AdaptiveOptions& opts = AdaptiveOptions(),
+                                                                         Engine engine = Engine::EigenDecomp,
+                                                                         const Smearing& smearing = Smearing()) {
+  double OscPars::* which = osc.pars().member(par);
+  if(!which) return oscillate(osc, par, (int)opts.maxPoints - 1, engine, smearing);
+  osc.update();
+  return sampleAdaptive(osc, which, par, opts, engine, smearing).probs;
+} // oscillateAdaptive()
+
+} // namespace neutosc
+
+#endif
@@ -0,0 +1,50 @@
+#include "AllocCounter.h"
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+
+// Replaces the global operator new and delete with ones that count into the
+// counters of AllocCounter.h.
+namespace {
+
+void count(const std::size_t size) {
+  ++neutosc::threadAllocs;
+  neutosc::totalAllocs.fetch_add(1, std::memory_order_relaxed);
+  neutosc::totalAllocBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void* countedAlloc(const std::size_t size) {
+  count(size);
+  void* ptr = std::malloc(size > 0? size: 1);
+  if(!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void* countedAlignedAlloc(const std::size_t size, const std::align_val_t align) {
+  count(size);
+  const std::size_t a = std::max<std::size_t>((std::size_t)align, sizeof(void*));
+  void* ptr = nullptr;
+  if(posix_memalign(&ptr, a, size > 0? size: 1) != 0) throw std::bad_alloc();
+  return ptr;
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return countedAlloc(size); }
+void* operator new[](std::size_t size) { return countedAlloc(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  try { return countedAlloc(size); } catch(...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  try { return countedAlloc(size); } catch(...) { return nullptr; }
+}
+void* operator new(std::size_t size, std::align_val_t align) { return countedAlignedAlloc(size, align); }
+void* operator new[](std::size_t size, std::align_val_t align) { return countedAlignedAlloc(size, align); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
@@ -0,0 +1,23 @@
+#ifndef ALLOCCOUNTER_H__
+#define ALLOCCOUNTER_H__
+
+// Allocation counters, incremented by the replacement operator new in AllocCounter.cpp.
+// Programs that link it (the bench, and the viewer with profiling on) get every
+// allocation that goes through operator new counted, per thread and over all threads.
+// In any other program the counters stay 0. Eigen's own aligned allocations of
+// dynamic matrices bypass it, fixed-size ones don't allocate.
+
+#include <atomic>
+#include <cstdint>
+
+namespace neutosc {
+
+// By the calling thread.
+inline thread_local uint64_t threadAllocs = 0;
+// By all threads.
+inline std::atomic<uint64_t> totalAllocs(0);
+inline std::atomic<uint64_t> totalAllocBytes(0);
+
+} // namespace neutosc
+
+#endif
@@ -6,13 +6,17 @@
 #include <Eigen/Dense>
 
 #include "NeutOsc.h"
+#include "PhysicsWorker.h"
 #include "Slider.h"
+#include "Resources.h"
 
 #define PI 3.14159265358979323846
 
 class ControlPanel {
   private:
   std::vector<Slider> sliders;
+  const Resources& resources;
+  std::vector<sf::Vertex> labels; // All slider labels as one triangle list on the atlas.
 
   // Animating variables.
   bool animating = false;
@@ -25,17 +29,17 @@ class ControlPanel {
   sf::Vector2u oldWindowSize;
 
   public:
-  ControlPanel(sf::RenderWindow& window, neutosc::OscPars& op):
-    window(window) {
-    Slider th12slider(op.th12, "theta_12.png");
-    Slider th23slider(op.th23, "theta_23.png");
-    Slider th13slider(op.th13, "theta_13.png");
-    Slider dCPslider(op.dCP, "delta_CP.png");
-    Slider Dm21sqslider(op.Dm21sq, "Delta_m_21^2.png");
-    Slider Dm31sqslider(op.Dm31sq, "Delta_m_31^2.png");
-    Slider rhoslider(op.rho, "rho.png");
-    Slider Lslider(op.L, "L.png");
-    Slider Eslider(op.E, "E.png");
+  ControlPanel(sf::RenderWindow& window, const Resources& resources, neutosc::OscPars& op):
+    resources(resources), window(window) {
+    Slider th12slider(op.th12, resources, "theta_12.png");
+    Slider th23slider(op.th23, resources, "theta_23.png");
+    Slider th13slider(op.th13, resources, "theta_13.png");
+    Slider dCPslider(op.dCP, resources, "delta_CP.png");
+    Slider Dm21sqslider(op.Dm21sq, resources, "Delta_m_21^2.png");
+    Slider Dm31sqslider(op.Dm31sq, resources, "Delta_m_31^2.png");
+    Slider rhoslider(op.rho, resources, "rho.png");
+    Slider Lslider(op.L, resources, "L.png");
+    Slider Eslider(op.E, resources, "E.png");
 
     th12slider.setLimits(0, PI);
     th23slider.setLimits(0, PI);
@@ -80,9 +84,11 @@ class ControlPanel {
   }
 
   void draw() {
+    PROFILE_SCOPE("ControlPanel::draw");
     for(Slider& slider : sliders) {
       slider.draw(window);
     }
+    window.draw(labels.data(), labels.size(), sf::PrimitiveType::Triangles, &resources.atlas());
     if(animating) sliders[last_active].animate();
   }
 
@@ -99,6 +105,8 @@ class ControlPanel {
       sliders[si].setPosition(pos.x + size.x/2 * 1.1, pos.y + (1+si)* size.y / (sliders.size()+1));
       sliders[si].update();
     }
+    labels.clear();
+    for(const Slider& slider : sliders) slider.appendLabel(labels);
   }
 
   void setPosition(const int x, const int y) {
@@ -157,4 +165,13 @@ class ControlPanel {
   double& lastActiveVar() {
     return sliders[last_active].getVal();
   }
+
+  // How the animated parameter of op moves per frame, or no animation if not animating.
+  neutosc::Animation animation(const neutosc::OscPars& op) {
+    neutosc::Animation anim;
+    if(!animating) return anim;
+    anim.which = op.member(lastActiveVar());
+    anim.next = sliders[last_active].animationStep();
+    return anim;
+  }
 }; // class ControlPanel
\ No newline at end of file
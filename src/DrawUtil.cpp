@@ -1,4 +1,5 @@
 #include "DrawUtil.h"
+#include "Profiler.h"
 #include <iostream>
 
 namespace DrawUtil {
@@ -9,6 +10,13 @@ void Line(sf::RenderWindow& window, const sf::Vector2f& a, const sf::Vector2f& b
   window.draw(tribuff.data(), tribuff.size(), sf::PrimitiveType::TriangleStrip);
 }
 
+void LineTriangles(std::vector<sf::Vertex>& triangles, const sf::Vector2f& a, const sf::Vector2f& b,
+                   const double thickness) {
+  const sf::Vector2f norm = normal(a, b)*(float)thickness/2.f;
+  const sf::Vertex quad[6] = {a+norm, a-norm, b+norm, a-norm, b-norm, b+norm};
+  triangles.insert(triangles.end(), quad, quad+6);
+}
+
 sf::Vector2f normalized(const sf::Vector2f a) {
   return a/(float)sqrt(a.x*a.x + a.y*a.y);
 }
@@ -24,6 +32,7 @@ sf::Vector2f miter(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vecto
 
 // Function to convert point-to-point vertex arrays into triangle strips with thickness.
 std::vector<sf::Vertex> TriStrip(const std::vector<sf::Vertex>& drawing, const double thickness){
+  PROFILE_SCOPE("TriStrip");
   std::vector<sf::Vertex> result(drawing.size()*2);
   for(int vi=1; vi<drawing.size()-1; ++vi) {
     // Three vertices form an angle around which to find miter points.
@@ -46,20 +55,40 @@ std::vector<sf::Vertex> TriStrip(const std::vector<sf::Vertex>& drawing, const d
   return result;
 } // TriStrip
 
-TernaryGraph::TernaryGraph(sf::RenderWindow& window):
+// Function to turn a path of probabilities into coloured and highlight triangle strips.
+void PathStrips(const std::vector<Eigen::Vector3f>& probs, const sf::Vector2f& top,
+                const sf::Vector2f& left, const sf::Vector2f& right,
+                std::vector<sf::Vertex>& drawing, std::vector<sf::Vertex>& highlight,
+                const float scale) {
+  PROFILE_SCOPE("PathStrips");
+  drawing.resize(probs.size());
+  for(int di = 0; di < probs.size(); ++di) {
+    drawing[di] = left + probs[di](0)*(top-left) + probs[di](1)*(right-left);
+  }
+  // Convert VertexArrays to arrays that can be plotted smoothly with triangle strips.
+  highlight = TriStrip(drawing, 10*scale);
+  drawing = TriStrip(drawing, 6*scale);
+  // Add a splash of colour.
+  for(int i = 0; i < drawing.size(); ++i) {
+    // Normalise colours so there's always one out of rgb at 255.
+    const float cmax = std::max(std::max(probs[i/2](0), probs[i/2](1)), probs[i/2](2));
+    drawing[i].color = sf::Color(255*probs[i/2](2)/cmax,
+                                 255*probs[i/2](0)/cmax,
+                                 255*probs[i/2](1)/cmax);
+  }
+  // Make sure the highlight is drawn in white.
+  for(int i = 0; i < highlight.size(); ++i) {
+    highlight[i].color = sf::Color::White;
+  }
+} // PathStrips
+
+TernaryGraph::TernaryGraph(sf::RenderWindow& window, const Resources& resources):
         triangle(100,3), tcentre(0,0), triangleR(0),
         window(window),width(window.getSize().x), height(window.getSize().y),
         oldWindowSize(window.getSize()), centre(pos.x+width*0.5, pos.y+height*0.5) {
-  // Load textures.
-  nulabeltex[0].loadFromFile("../textures/nu_e.png");
-  nulabeltex[1].loadFromFile("../textures/nu_mu.png");
-  nulabeltex[2].loadFromFile("../textures/nu_tau.png");
-  nulabeltex[3].loadFromFile("../textures/bar_nu_e.png");
-  nulabeltex[4].loadFromFile("../textures/bar_nu_mu.png");
-  nulabeltex[5].loadFromFile("../textures/bar_nu_tau.png");
-  // Assign textures to sprites and set origin.
+  // Label sprites, in the order of Resources::labelNames(), and their origins.
   for(int nui = 0; nui < 6; ++nui) {
-    nulabelsprite[nui].setTexture(nulabeltex[nui]);
+    nulabelsprite[nui] = resources.sprite(Resources::labelNames()[nui]);
     nulabelsprite[nui].setOrigin(nulabelsprite[nui].getLocalBounds().width/2, nulabelsprite[nui].getLocalBounds().height/2);
   }
   
@@ -81,51 +110,163 @@ sf::Vector3f TernaryGraph::InvTriPoint(const sf::Vertex& a) {
   return sf::Vector3f(ecomp, mucomp, 1-ecomp-mucomp);
 }
 
+// Draw the outline, grid and labels.
+void TernaryGraph::drawStatic(sf::RenderTarget& target) {
+  target.draw(triangle);
+  target.draw(grid.data(), grid.size(), sf::PrimitiveType::Triangles);
+  target.draw(nulabelsprite[0 + (int)anti*3]);
+  target.draw(nulabelsprite[1 + (int)anti*3]);
+  target.draw(nulabelsprite[2 + (int)anti*3]);
+} // TernaryGraph::drawStatic()
+
+// Render the static layer into its texture.
+void TernaryGraph::updateStatic() {
+  PROFILE_SCOPE("TernaryGraph::updateStatic");
+  staticDirty = false;
+  const sf::Vector2u size = window.getSize();
+  if(size.x == 0 || size.y == 0) return;
+  if(staticLayer.getSize() != size) {
+    // With the window's settings, so the layer is antialiased like the rest.
+    staticCached = staticLayer.create(size.x, size.y, window.getSettings());
+    if(!staticCached) return;
+    staticSprite.setTexture(staticLayer.getTexture(), true);
+  }
+  staticLayer.clear(sf::Color::Transparent);
+  drawStatic(staticLayer);
+  staticLayer.display();
+} // TernaryGraph::updateStatic()
+
 // Draw everything in class.
 void TernaryGraph::draw() {
-  window.draw(triangle);
-
-  // Draw divider lines.
-  for(int i = 0; i <= numDiv; ++i) {
-    const sf::Vector2f a = left + (float)i*(top-left)/(float)numDiv
-                           - sf::Vector2f(triangleR*0.1, 0); // Offset for ticks.
-    const sf::Vector2f b = right + (float)i*(top-right)/(float)numDiv;
-    Line(window, a, b, 0.5);
-    const sf::Vector2f a120 = rot120.transformPoint(a);
-    const sf::Vector2f b120 = rot120.transformPoint(b);
-    Line(window, a120, b120, 0.5);
-    const sf::Vector2f a240 = rot240.transformPoint(a);
-    const sf::Vector2f b240 = rot240.transformPoint(b);
-    Line(window, a240, b240, 0.5);
+  PROFILE_SCOPE("TernaryGraph::draw");
+  if(staticDirty) updateStatic();
+  if(staticCached) {
+    // The texture holds colours already multiplied by their alpha.
+    window.draw(staticSprite, sf::BlendMode(sf::BlendMode::One, sf::BlendMode::OneMinusSrcAlpha));
+  } else {
+    drawStatic(window);
   }
 
-  // Draw labels.
-  window.draw(nulabelsprite[0 + (int)anti*3]);
-  window.draw(nulabelsprite[1 + (int)anti*3]);
-  window.draw(nulabelsprite[2 + (int)anti*3]);
+  // Heatmap and bands go under the drawings.
+  const sf::RenderStates states(graphTransform);
+  if(showHeatmap) window.draw(heatmapSprite, states);
+  for(size_t bi = 0; bi < numBands; ++bi) {
+    const Band& band = bands[bi];
+    if(band.strip.empty()) {
+      window.draw(band.buffer, 0, band.size, states);
+    } else {
+      window.draw(band.strip.data(), band.size, sf::PrimitiveType::TriangleStrip, states);
+    }
+  }
 
   // Draw all added drawings and their highlights.
-  for(int di = 0; di < drawings.size(); ++di) {
-    const std::vector<sf::Vertex>& drawing = drawings[di];
-    window.draw(drawing.data(), std::min((size_t)t*10,drawing.size()), sf::PrimitiveType::TriangleStrip);
+  for(size_t ci = 0; ci < numCurves; ++ci) {
+    const Curve& curve = curves[ci];
+    const size_t numvtx = std::min((size_t)t*10, curve.drawingSize);
+    if(curve.drawing.empty()) {
+      window.draw(curve.drawingBuffer, 0, numvtx, states);
+    } else {
+      window.draw(curve.drawing.data(), numvtx, sf::PrimitiveType::TriangleStrip, states);
+    }
   }
-  for(std::vector<sf::Vertex>& highlight : highlights) {
-    const int start = int(t*2)%highlight.size();
-    const int numvtx = std::min(10, (int)(highlight.size() - start));
-    window.draw(highlight.data()+start, numvtx, sf::PrimitiveType::TriangleStrip);
+  for(size_t ci = 0; ci < numCurves; ++ci) {
+    const Curve& curve = curves[ci];
+    if(curve.highlightSize == 0) continue;
+    const size_t start = size_t(t*2)%curve.highlightSize;
+    const size_t numvtx = std::min((size_t)10, curve.highlightSize - start);
+    if(curve.highlight.empty()) {
+      window.draw(curve.highlightBuffer, start, numvtx, states);
+    } else {
+      window.draw(curve.highlight.data()+start, numvtx, sf::PrimitiveType::TriangleStrip, states);
+    }
   }
 
   // Advance graph time for initial drawing animation.
   ++t;
 } // TernaryGraph::draw()
 
+bool TernaryGraph::isAnimating() const {
+  // t has already moved on from the frame on screen.
+  for(size_t ci = 0; ci < numCurves; ++ci) {
+    if((t - 1)*10 < curves[ci].drawingSize) return true;
+  }
+  return false;
+}
+
+void TernaryGraph::addDrawing(const std::vector<Eigen::Vector3f>& vec) {
+  PROFILE_SCOPE("TernaryGraph::addDrawing");
+  if(vec.size() < 2) return;
+  if(numCurves == curves.size()) curves.emplace_back();
+  Curve& curve = curves[numCurves++];
+  // Graph space corners, with strips as wide relative to the triangle as they'd be on screen now.
+  const float h = graphSide*sqrt(0.75);
+  PathStrips(vec, sf::Vector2f(graphSide*0.5, -h), sf::Vector2f(0, 0), sf::Vector2f(graphSide, 0),
+             scratchDrawing, scratchHighlight, sideL > 0? graphSide/sideL: 1);
+  curve.drawingSize = scratchDrawing.size();
+  curve.highlightSize = scratchHighlight.size();
+  if(sf::VertexBuffer::isAvailable()) {
+    // Buffers only grow, so a reused slot usually needs no new allocation.
+    if(curve.drawingBuffer.getVertexCount() < curve.drawingSize) curve.drawingBuffer.create(curve.drawingSize);
+    if(curve.highlightBuffer.getVertexCount() < curve.highlightSize) curve.highlightBuffer.create(curve.highlightSize);
+    if(curve.drawingBuffer.update(scratchDrawing.data(), curve.drawingSize, 0) &&
+       curve.highlightBuffer.update(scratchHighlight.data(), curve.highlightSize, 0)) {
+      curve.drawing.clear();
+      curve.highlight.clear();
+      return;
+    }
+  }
+  curve.drawing.swap(scratchDrawing);
+  curve.highlight.swap(scratchHighlight);
+}
+void TernaryGraph::setBands(const std::vector<std::vector<Eigen::Vector3f>>& lower,
+                            const std::vector<std::vector<Eigen::Vector3f>>& upper) {
+  PROFILE_SCOPE("TernaryGraph::setBands");
+  numBands = std::min(lower.size(), upper.size());
+  while(bands.size() < numBands) bands.emplace_back();
+  for(size_t bi = 0; bi < numBands; ++bi) {
+    Band& band = bands[bi];
+    const size_t n = std::min(lower[bi].size(), upper[bi].size());
+    // Overlapping bands add up, so the inner ones come out brighter.
+    const sf::Color colour(255, 255, 255, 48);
+    scratchDrawing.resize(2*n);
+    for(size_t i = 0; i < n; ++i) {
+      scratchDrawing[2*i] = sf::Vertex(GraphPoint(lower[bi][i]), colour);
+      scratchDrawing[2*i+1] = sf::Vertex(GraphPoint(upper[bi][i]), colour);
+    }
+    band.size = 2*n;
+    if(sf::VertexBuffer::isAvailable()) {
+      if(band.buffer.getVertexCount() < band.size) band.buffer.create(band.size);
+      if(band.buffer.update(scratchDrawing.data(), band.size, 0)) {
+        band.strip.clear();
+        continue;
+      }
+    }
+    band.strip.swap(scratchDrawing);
+  }
+}
+void TernaryGraph::setHeatmap(const std::vector<uint8_t>& rgba, const unsigned w, const unsigned h) {
+  PROFILE_SCOPE("TernaryGraph::setHeatmap");
+  if(w == 0 || h == 0 || rgba.size() < (size_t)w*h*4) return;
+  if(heatmapTexture.getSize() != sf::Vector2u(w, h)) {
+    if(!heatmapTexture.create(w, h)) return;
+    heatmapTexture.setSmooth(true);
+    heatmapSprite.setTexture(heatmapTexture, true);
+  }
+  heatmapTexture.update(rgba.data());
+  // Graph space has the left corner at the origin and the top corner above it.
+  heatmapSprite.setPosition(0, -graphSide*0.8660254f);
+  heatmapSprite.setScale(graphSide/w, graphSide*0.8660254f/h);
+  showHeatmap = true;
+}
 void TernaryGraph::addDrawing(const std::vector<Eigen::Vector3d>& vec) {
-    probs.push_back(vec);
-    updateWindow();
+    std::vector<Eigen::Vector3f> fvec(vec.size());
+    for(int i = 0; i < vec.size(); ++i) fvec[i] = vec[i].cast<float>();
+    addDrawing(fvec);
 }
 
 // Update all relevant parameters in case of a window size change.
 void TernaryGraph::updateWindow() {
+  PROFILE_SCOPE("TernaryGraph::updateWindow");
   // Scale by comparing old and new window size.
   const sf::Vector2f scale((float)window.getSize().x/oldWindowSize.x,
                            (float)window.getSize().y/oldWindowSize.y);
@@ -168,30 +309,23 @@ void TernaryGraph::updateWindow() {
   rot120.rotate(120, tcentre);
   rot240.rotate(240, tcentre);
 
-  // Determine VertexArrays from probability arrays.
-  drawings.resize(probs.size());
-  highlights.resize(probs.size());
-  for(int vi = 0; vi < probs.size(); ++vi) {
-    drawings[vi].resize(probs[vi].size());
-    for(int di = 0; di < probs[vi].size(); ++di) {
-      drawings[vi][di] = TriPoint(probs[vi][di]);
-    }
-    // Convert VertexArrays to arrays that can be plotted smoothly with triangle strips.
-    highlights[vi] = TriStrip(drawings[vi], 10);
-    drawings[vi] = TriStrip(drawings[vi], 6);
-    // Add a splash of colour.
-    for(int i = 0; i < drawings[vi].size(); ++i) {
-      // Normalise colours so there's always one out of rgb at 255.
-      const double cmax = std::max(std::max(probs[vi][i/2](0), probs[vi][i/2](1)), probs[vi][i/2](2));
-      drawings[vi][i].color = sf::Color(255*probs[vi][i/2](2)/cmax,
-                                        255*probs[vi][i/2](0)/cmax,
-                                        255*probs[vi][i/2](1)/cmax);
-    }
-    // Make sure the highlight is drawn in white.
-    for(int i = 0; i < highlights[vi].size(); ++i) {
-      highlights[vi][i].color = sf::Color::White;
-    }
+  // Divider lines, three sets of numDiv+1.
+  grid.clear();
+  for(int i = 0; i <= numDiv; ++i) {
+    const sf::Vector2f a = left + (float)i*(top-left)/(float)numDiv
+                           - sf::Vector2f(triangleR*0.1, 0); // Offset for ticks.
+    const sf::Vector2f b = right + (float)i*(top-right)/(float)numDiv;
+    LineTriangles(grid, a, b, 0.5);
+    LineTriangles(grid, rot120.transformPoint(a), rot120.transformPoint(b), 0.5);
+    LineTriangles(grid, rot240.transformPoint(a), rot240.transformPoint(b), 0.5);
   }
+  staticDirty = true;
+
+  // Drawings only need moving and scaling into the new triangle.
+  graphTransform = sf::Transform::Identity;
+  graphTransform.translate(left);
+  graphTransform.scale(sideL/graphSide, sideL/graphSide);
+
 }
 
 } // namespace DrawUtil
\ No newline at end of file
@@ -4,18 +4,32 @@
 #define GL_SILENCE_DEPRECATION
 
 #include <vector>
+#include <deque>
+#include <cstdint>
 #include <SFML/Graphics.hpp>
 #include <SFML/OpenGL.hpp>
 #include <Eigen/Dense>
 
+#include "Resources.h"
+
 namespace DrawUtil{
 
 void Line(sf::RenderWindow& window, const sf::Vector2f& a, const sf::Vector2f& b, const double width);
+// Function to append a line as two triangles, for batching many lines into one draw.
+void LineTriangles(std::vector<sf::Vertex>& triangles, const sf::Vector2f& a, const sf::Vector2f& b,
+                   const double width);
 sf::Vector2f normalized(const sf::Vector2f a);
 sf::Vector2f normal(const sf::Vector2f& a, const sf::Vector2f& b);
 sf::Vector2f miter(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vector2f& c);
 // Function to convert point-to-point vertex arrays into triangle strips.
 std::vector<sf::Vertex> TriStrip(const std::vector<sf::Vertex>& drawing, const double thickness);
+// Function to turn a path of probabilities into a coloured triangle strip and a white
+// highlight strip, for a ternary plot with the given corners. Needs no window. The
+// strips are 6 and 10 times scale wide.
+void PathStrips(const std::vector<Eigen::Vector3f>& probs, const sf::Vector2f& top,
+                const sf::Vector2f& left, const sf::Vector2f& right,
+                std::vector<sf::Vertex>& drawing, std::vector<sf::Vertex>& highlight,
+                const float scale = 1);
 
 class TernaryGraph {
   private:
@@ -41,13 +55,57 @@ class TernaryGraph {
   sf::Transform rot120;
   sf::Transform rot240;
 
-  // Drawings.
-  std::vector<std::vector<Eigen::Vector3d>> probs;
-  std::vector<std::vector<sf::Vertex>> drawings;
-  std::vector<std::vector<sf::Vertex>> highlights;
+  // Static layer: outline, grid and labels, rendered once per window change and then
+  // drawn as one sprite. Drawn directly if render textures aren't available.
+  std::vector<sf::Vertex> grid; // Divider lines as a triangle list.
+  sf::RenderTexture staticLayer;
+  sf::Sprite staticSprite;
+  bool staticCached = false;
+  bool staticDirty = true;
+  void drawStatic(sf::RenderTarget& target);
+  void updateStatic();
+
+  // Drawings. Their geometry is built once, in graph space, where the triangle has
+  // side graphSide with its left corner at the origin, and kept in vertex buffers if
+  // the GPU has them. Resizing only changes graphTransform, from graph to window space.
+  struct Curve {
+    std::vector<sf::Vertex> drawing; // Only kept without vertex buffers.
+    std::vector<sf::Vertex> highlight;
+    sf::VertexBuffer drawingBuffer;
+    sf::VertexBuffer highlightBuffer;
+    size_t drawingSize = 0;
+    size_t highlightSize = 0;
+    Curve(): drawingBuffer(sf::PrimitiveType::TriangleStrip, sf::VertexBuffer::Static),
+             highlightBuffer(sf::PrimitiveType::TriangleStrip, sf::VertexBuffer::Static) {}
+  };
+  static constexpr float graphSide = 1000;
+  std::deque<Curve> curves; // Slots are reused after clear(), keeping their buffers.
+  size_t numCurves = 0;
+  sf::Transform graphTransform;
+  std::vector<sf::Vertex> scratchDrawing; // Strips before upload to the vertex buffers.
+  std::vector<sf::Vertex> scratchHighlight;
+  // Graph space position of a probability vector.
+  sf::Vector2f GraphPoint(const Eigen::Vector3f& p) const {
+    return sf::Vector2f(graphSide*(p(1) + 0.5f*p(0)), -graphSide*0.8660254f*p(0));
+  }
 
-  // Textures aand sprites for labels
-  sf::Texture nulabeltex[6];
+  // Uncertainty bands, translucent strips between their lower and upper edges, kept
+  // like the drawings but in buffers meant for frequent updates.
+  struct Band {
+    std::vector<sf::Vertex> strip; // Only kept without vertex buffers.
+    sf::VertexBuffer buffer;
+    size_t size = 0;
+    Band(): buffer(sf::PrimitiveType::TriangleStrip, sf::VertexBuffer::Stream) {}
+  };
+  std::deque<Band> bands;
+  size_t numBands = 0;
+
+  // Density heatmap, an image covering the triangle's bounding box.
+  sf::Texture heatmapTexture;
+  sf::Sprite heatmapSprite;
+  bool showHeatmap = false;
+
+  // Sprites for labels, from the shared atlas.
   sf::Sprite nulabelsprite[6];
   bool anti = false; // Draw (anti)neutrino textures.
 
@@ -55,12 +113,12 @@ class TernaryGraph {
   // Animation time.
   double t = 0;
 
-  TernaryGraph(sf::RenderWindow& window);
+  TernaryGraph(sf::RenderWindow& window, const Resources& resources);
 
   // Function to transform a 3D vector into a 2D location on the ternary plot.
   sf::Vector2f TriPoint(float e, float mu, float tau);
   sf::Vector2f TriPoint(sf::Vector3f a) { return TriPoint(a.x,a.y,a.z); }
-  sf::Vector2f TriPoint(Eigen::Vector3d a) { return TriPoint(a(0),a(1),(2)); }
+  sf::Vector2f TriPoint(const Eigen::Vector3f& a) { return TriPoint(a(0),a(1),a(2)); }
   // Function to transform from 2D ternary point to 3D probability vector.
   sf::Vector3f InvTriPoint(const sf::Vertex& a);
 
@@ -73,14 +131,28 @@ class TernaryGraph {
   }
   
   // Set antineutrino labels.
-  void setAnti(bool val) { anti = val; }
+  void setAnti(bool val) {
+    if(val != anti) staticDirty = true;
+    anti = val;
+  }
 
   // Draw everything in class.
   void draw();
+  // Whether the intro animation, which draws the paths in bit by bit, is still going.
+  bool isAnimating() const;
   // Add a drawing in the form of a vector of 3D positions.
+  void addDrawing(const std::vector<Eigen::Vector3f>& vec);
   void addDrawing(const std::vector<Eigen::Vector3d>& vec);
   // Clear all drawings.
-  void clear() { probs.resize(0); }
+  void clear() { numCurves = 0; }
+  // Replace the uncertainty bands, each given by its lower and upper edge paths.
+  void setBands(const std::vector<std::vector<Eigen::Vector3f>>& lower,
+                const std::vector<std::vector<Eigen::Vector3f>>& upper);
+  void clearBands() { numBands = 0; }
+  // Show a density heatmap, an RGBA image of the triangle's bounding box from the top
+  // row down, as made by neutosc::TernaryHistogram::toneMap().
+  void setHeatmap(const std::vector<uint8_t>& rgba, const unsigned w, const unsigned h);
+  void clearHeatmap() { showHeatmap = false; }
   // Update all relevant parameters in case of a window size change.
   void updateWindow();
 
@@ -0,0 +1,35 @@
+#include "EarthModel.h"
+
+namespace neutosc {
+
+std::vector<Segment> trajectory(const DensityProfile& profile, const double cosz, const double h) {
+  const double R = profile.radius();
+  const double total = -R*cosz + sqrt(R*R*cosz*cosz + (R+h)*(R+h) - R*R);
+  const std::vector<Shell>& shells = profile.getShells();
+  std::vector<Segment> path;
+  // Going down, or an empty profile, never enters a shell.
+  if(cosz >= 0 || shells.empty()) {
+    path.push_back(Segment{-1, total});
+    return path;
+  }
+  const double chord = -2*R*cosz;
+  path.push_back(Segment{-1, total - chord});
+
+  // Half the chord length within radius r for impact parameter b.
+  const double b2 = R*R*(1 - cosz*cosz);
+  auto halfChord = [b2](const double r) { return r*r > b2? sqrt(r*r - b2): 0.; };
+  int inner = shells.size()-1; // Deepest shell that is crossed.
+  while(inner > 0 && shells[inner-1].rmax*shells[inner-1].rmax > b2) --inner;
+
+  // Down through the outer shells, straight through the deepest, and back out.
+  for(int si = shells.size()-1; si > inner; --si) {
+    path.push_back(Segment{si, halfChord(shells[si].rmax) - halfChord(shells[si].rmin)});
+  }
+  path.push_back(Segment{inner, 2*halfChord(shells[inner].rmax)});
+  for(int si = inner+1; si < shells.size(); ++si) {
+    path.push_back(Segment{si, halfChord(shells[si].rmax) - halfChord(shells[si].rmin)});
+  }
+  return path;
+} // trajectory()
+
+} // namespace neutosc
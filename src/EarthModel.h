@@ -0,0 +1,177 @@
+#ifndef EARTHMODEL_H__
+#define EARTHMODEL_H__
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "NeutOsc.h"
+
+namespace neutosc {
+
+// A spherical shell of constant density.
+struct Shell {
+  double rmin; // In km.
+  double rmax; // In km.
+  double rho; // In kg/m^3.
+};
+
+// Spherically symmetric, piecewise constant density profile.
+class DensityProfile {
+  private:
+  std::vector<Shell> shells; // Ordered from the centre outwards.
+
+  public:
+  // Add a shell on top of the existing ones, reaching up to radius rmax.
+  void addShell(const double rmax, const double rho) {
+    const double rmin = shells.empty()? 0: shells.back().rmax;
+    shells.push_back(Shell{rmin, rmax, rho});
+  }
+
+  const std::vector<Shell>& getShells() const { return shells; }
+  double radius() const { return shells.empty()? 0: shells.back().rmax; }
+
+  // Preliminary Reference Earth Model (Dziewonski & Anderson 1981),
+  // averaged over each of its standard shells.
+  static DensityProfile prem() {
+    DensityProfile p;
+    p.addShell(1221.5, 12894); // Inner core.
+    p.addShell(3480.0, 10900); // Outer core.
+    p.addShell(3630.0, 5528); // D'' layer.
+    p.addShell(5600.0, 4906); // Lower mantle.
+    p.addShell(5701.0, 4411);
+    p.addShell(5771.0, 3992); // Transition zone.
+    p.addShell(5971.0, 3853);
+    p.addShell(6151.0, 3491);
+    p.addShell(6346.6, 3366); // Low velocity zone and lid.
+    p.addShell(6356.0, 2900); // Lower crust.
+    p.addShell(6371.0, 2600); // Upper crust.
+    return p;
+  }
+}; // class DensityProfile
+
+// A straight piece of a trajectory inside one shell, or in the atmosphere if shell < 0.
+struct Segment {
+  int shell;
+  double length; // In km.
+};
+
+// Path from the production point to a detector at the surface for a zenith angle.
+// cosz = 1 comes straight down, cosz = -1 crosses the whole Earth.
+// Neutrinos are produced at height h above the surface (in km). With an empty profile
+// the whole path, h long, is in the atmosphere.
+std::vector<Segment> trajectory(const DensityProfile& profile, const double cosz, const double h = 15);
+
+// Propagates through a layered density profile. The eigensystem of every shell only
+// depends on the energy, so it's computed once and shared by all trajectories.
+// Each segment then only costs three phases.
+class EarthPropagator {
+  public:
+  // Per-shell eigensystems for one energy, and the vacuum one for the atmosphere.
+  struct Layers {
+    std::vector<Oscillator::MatterEigen> shells;
+    Oscillator::MatterEigen vac;
+    // From the eigenbasis of each shell's outer neighbour into its own, W_si^+ W_si+1,
+    // so that crossing into the next shell costs one product instead of two.
+    std::vector<Eigen::Matrix3cd> inward;
+
+    const Oscillator::MatterEigen& operator[](const int shell) const {
+      return shell < 0? vac: shells[shell];
+    }
+  };
+
+  static void layers(const Oscillator& osc, const DensityProfile& profile, const double E, Layers& out) {
+    const std::vector<Shell>& shells = profile.getShells();
+    out.shells.resize(shells.size());
+    for(int si = 0; si < shells.size(); ++si) {
+      out.shells[si] = osc.matterEigen(E, shells[si].rho);
+    }
+    out.vac = osc.matterEigen(E, 0);
+    out.inward.resize(shells.size() > 0? shells.size()-1: 0);
+    for(int si = 0; si+1 < shells.size(); ++si) {
+      out.inward[si] = out.shells[si].W.adjoint()*out.shells[si+1].W;
+    }
+  } // EarthPropagator::layers()
+
+  // Flavour probabilities after a trajectory, for the oscillator's initial flavour and the
+  // energy the layers were computed for.
+  static Eigen::Vector3d trans(const Oscillator& osc, const Layers& layers, const std::vector<Segment>& path) {
+    // Apply the segment evolutions to the state directly, kept in the eigenbasis of the
+    // current segment and moved straight into the next one's.
+    const Eigen::Vector3cd psi = osc.mixing().adjoint().col(osc.pars().nu);
+    Eigen::Vector3cd b;
+    int prev = 0;
+    for(size_t si = 0; si < path.size(); ++si) {
+      const Segment& seg = path[si];
+      const Oscillator::MatterEigen& me = layers[seg.shell];
+      if(si == 0) b = me.W.adjoint()*psi;
+      else if(seg.shell == prev) {}
+      else if(seg.shell >= 0 && seg.shell+1 == prev) b = layers.inward[seg.shell]*b;
+      else if(prev >= 0 && prev+1 == seg.shell) b = layers.inward[prev].adjoint()*b;
+      else b = me.W.adjoint()*(layers[prev].W*b).eval();
+      for(int j = 0; j < 3; ++j) b(j) *= std::polar(1., -me.lambda(j)*seg.length);
+      prev = seg.shell;
+    }
+    if(path.empty()) return (osc.mixing()*psi).cwiseAbs2();
+    return (osc.mixing()*(layers[prev].W*b)).cwiseAbs2();
+  } // EarthPropagator::trans()
+
+  private:
+  const Oscillator& osc;
+  DensityProfile profile;
+
+  // Layers for one energy and oscillator state.
+  double cacheE = -1;
+  unsigned long cacheVersion = 0;
+  Layers cache;
+
+  public:
+  EarthPropagator(const Oscillator& osc, const DensityProfile& profile = DensityProfile::prem()):
+    osc(osc), profile(profile) {}
+
+  const DensityProfile& getProfile() const { return profile; }
+
+  // Compute the shell eigensystems for energy E, unless they are still valid.
+  void prepare(const double E) {
+    if(E == cacheE && osc.getVersion() == cacheVersion) return;
+    layers(osc, profile, E, cache);
+    cacheE = E;
+    cacheVersion = osc.getVersion();
+  } // EarthPropagator::prepare()
+
+  // Mass basis evolution matrix of a whole trajectory, as a product of per-segment ones.
+  Eigen::Matrix3cd evolution(const std::vector<Segment>& path, const double E) {
+    prepare(E);
+    Eigen::Matrix3cd A = Eigen::Matrix3cd::Identity();
+    for(const Segment& seg : path) {
+      const Oscillator::MatterEigen& me = cache[seg.shell];
+      Eigen::Matrix3cd S = me.W;
+      for(int j = 0; j < 3; ++j) S.col(j) *= std::polar(1., -me.lambda(j)*seg.length);
+      A = S*me.W.adjoint()*A;
+    }
+    return A;
+  } // EarthPropagator::evolution()
+
+  // Flavour probabilities after a trajectory for the oscillator's energy and initial flavour.
+  Eigen::Vector3d trans(const std::vector<Segment>& path) {
+    prepare(osc.pars().E);
+    return trans(osc, cache, path);
+  } // EarthPropagator::trans()
+
+  Eigen::Vector3d trans(const double cosz) {
+    return trans(trajectory(profile, cosz));
+  }
+
+  // Probabilities for many zenith angles at the oscillator's energy.
+  void zenithBatch(const double* cosz, const size_t n, Eigen::Vector3d* out) {
+    prepare(osc.pars().E);
+    for(size_t i = 0; i < n; ++i) {
+      out[i] = trans(osc, cache, trajectory(profile, cosz[i]));
+    }
+  } // EarthPropagator::zenithBatch()
+}; // class EarthPropagator
+
+} // namespace neutosc
+
+#endif
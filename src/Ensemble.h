@@ -0,0 +1,248 @@
+#ifndef ENSEMBLE_H__
+#define ENSEMBLE_H__
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include "NeutOsc.h"
+#include "Parallel.h"
+#include "PhysicsWorker.h"
+
+namespace neutosc {
+
+// Gaussian prior on one oscillation parameter, centred on its current value.
+struct Prior {
+  double OscPars::* which;
+  double sigma;
+};
+
+// Roughly the 1 sigma ranges of the NuFIT 5.2 global fit (normal ordering), symmetrised.
+inline std::vector<Prior> defaultPriors() {
+  return {{&OscPars::th12, 0.0131}, {&OscPars::th23, 0.018}, {&OscPars::th13, 0.0019},
+          {&OscPars::dCP, 0.55}, {&OscPars::Dm21sq, 0.21e-5}, {&OscPars::Dm31sq, 0.027e-3}};
+}
+
+// Percentile bands of an ensemble of paths vs L, around the path of the central
+// parameters. At each point, the members' points are projected onto the normal of the
+// central path in the ternary plot. Band k spans the middle levels[k] of those offsets.
+struct EnsembleBands {
+  OscPars pars; // Central parameters.
+  size_t numMembers = 0;
+  std::vector<double> levels;
+  std::vector<Eigen::Vector3f> central;
+  std::vector<std::vector<Eigen::Vector3f>> lower; // Per level, per point.
+  std::vector<std::vector<Eigen::Vector3f>> upper;
+}; // struct EnsembleBands
+
+// Paths of parameter sets drawn from Gaussian priors around a central set, evaluated
+// over all cores a batch at a time, so that the bands can be shown while they fill in.
+// The same standard normal draws are used for every centre, so the bands move smoothly
+// as the centre does.
+class Ensemble {
+  public:
+  typedef Eigen::Vector2f Vector2;
+
+  private:
+  std::vector<Prior> priors;
+  std::vector<double> levels;
+  int numsteps;
+  size_t maxMembers;
+  std::vector<double> z; // Standard normal draws, member-major.
+
+  OscPars centre;
+  std::vector<double> xs; // Baselines of every path.
+  std::vector<Eigen::Vector3f> central;
+  std::vector<Vector2> normals; // Unit normals of the central path in the ternary plane.
+  std::vector<float> offsets; // Distance along the normal, member-major.
+  size_t numMembers = 0;
+
+  // Per-worker state.
+  std::vector<OscillatorF> oscs;
+  std::vector<std::vector<Eigen::Vector3f>> paths;
+  mutable std::vector<std::vector<float>> columns;
+
+  // Position in the ternary plane, with e at the top, mu right and tau left. The same
+  // linear map as TernaryGraph::TriPoint() up to scale, so normals are true normals.
+  static Vector2 plane(const Eigen::Vector3f& p) {
+    return Vector2(p(1) + 0.5f*p(0), -0.8660254f*p(0));
+  }
+  // Change in probabilities for a step in the ternary plane.
+  static Eigen::Vector3f probStep(const Vector2& d) {
+    const float de = -d.y()/0.8660254f;
+    const float dmu = d.x() - 0.5f*de;
+    return Eigen::Vector3f(de, dmu, -de-dmu);
+  }
+
+  public:
+  Ensemble(const size_t maxMembers = 10000, const int numsteps = 500,
+           const std::vector<Prior>& priors = defaultPriors(),
+           const std::vector<double>& levels = {0.683, 0.954}, const unsigned seed = 1):
+    priors(priors), levels(levels), numsteps(numsteps), maxMembers(maxMembers),
+    z(maxMembers*priors.size()), xs(numsteps+1), oscs(numWorkers()), paths(numWorkers()),
+    columns(numWorkers()) {
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<double> normal;
+    for(double& val : z) val = normal(rng);
+    offsets.reserve(maxMembers*xs.size());
+  }
+
+  size_t size() const { return numMembers; }
+  size_t capacity() const { return maxMembers; }
+  bool done() const { return numMembers >= maxMembers; }
+  const OscPars& pars() const { return centre; }
+
+  // Drop all members and start again around new central parameters.
+  void reset(const OscPars& pars) {
+    centre = pars;
+    numMembers = 0;
+    offsets.clear();
+    for(size_t i = 0; i < xs.size(); ++i) xs[i] = pars.L*i/numsteps;
+
+    OscillatorF& osc = oscs[0];
+    osc.pars() = pars;
+    osc.update();
+    central.resize(xs.size());
+    osc.transBatch(xs.data(), xs.size(), &OscPars::L, central.data());
+
+    // Normals from the neighbouring points, keeping the last one where the path stalls.
+    normals.resize(xs.size());
+    Vector2 last(0, 1);
+    for(size_t i = 0; i < xs.size(); ++i) {
+      const Vector2 tangent = plane(central[std::min(i+1, xs.size()-1)]) - plane(central[i > 0? i-1: 0]);
+      if(tangent.norm() > 1e-7f) last = Vector2(-tangent.y(), tangent.x()).normalized();
+      normals[i] = last;
+    }
+  } // Ensemble::reset()
+
+  // Evaluate up to count more members. Returns the number of members so far.
+  size_t add(const size_t count, const unsigned workers = numWorkers()) {
+    PROFILE_SCOPE("Ensemble::add");
+    const size_t first = numMembers;
+    const size_t last = std::min(maxMembers, numMembers + count);
+    const size_t npts = xs.size();
+    offsets.resize(last*npts);
+    parallelFor(last - first, 16, [&](const unsigned wi, const size_t m0, const size_t m1) {
+      OscillatorF& osc = oscs[wi];
+      std::vector<Eigen::Vector3f>& path = paths[wi];
+      path.resize(npts);
+      for(size_t m = first + m0; m < first + m1; ++m) {
+        osc.pars() = centre;
+        for(size_t pi = 0; pi < priors.size(); ++pi) {
+          osc.pars().*priors[pi].which += priors[pi].sigma*z[m*priors.size() + pi];
+        }
+        osc.update();
+        osc.transBatch(xs.data(), npts, &OscPars::L, path.data());
+        float* out = offsets.data() + m*npts;
+        for(size_t i = 0; i < npts; ++i) out[i] = normals[i].dot(plane(path[i]) - plane(central[i]));
+      }
+    }, std::min<unsigned>(workers, oscs.size()));
+    numMembers = last;
+    return numMembers;
+  } // Ensemble::add()
+
+  // Percentile bands of the members so far.
+  void bands(EnsembleBands& out, const unsigned workers = numWorkers()) const {
+    PROFILE_SCOPE("Ensemble::bands");
+    const size_t npts = xs.size();
+    out.pars = centre;
+    out.numMembers = numMembers;
+    out.levels = levels;
+    out.central = central;
+    out.lower.resize(levels.size());
+    out.upper.resize(levels.size());
+    for(size_t li = 0; li < levels.size(); ++li) {
+      out.lower[li].resize(npts);
+      out.upper[li].resize(npts);
+    }
+    if(numMembers == 0) {
+      for(size_t li = 0; li < levels.size(); ++li) {
+        out.lower[li] = central;
+        out.upper[li] = central;
+      }
+      return;
+    }
+
+    struct Quantile {
+      double q;
+      size_t level;
+      bool upper;
+    };
+    std::vector<Quantile> quantiles;
+    for(size_t li = 0; li < levels.size(); ++li) {
+      quantiles.push_back(Quantile{0.5*(1 - levels[li]), li, false});
+      quantiles.push_back(Quantile{0.5*(1 + levels[li]), li, true});
+    }
+    std::sort(quantiles.begin(), quantiles.end(),
+              [](const Quantile& l, const Quantile& r) { return l.q < r.q; });
+
+    parallelFor(npts, 64, [&](const unsigned wi, const size_t i0, const size_t i1) {
+      std::vector<float>& column = columns[wi];
+      column.resize(numMembers);
+      for(size_t i = i0; i < i1; ++i) {
+        for(size_t m = 0; m < numMembers; ++m) column[m] = offsets[m*npts + i];
+        const Eigen::Vector3f step = probStep(normals[i]);
+        // Lowest quantile first; each later one only needs to search above the last.
+        size_t from = 0;
+        for(const Quantile& q : quantiles) {
+          const size_t k = std::max(from, std::min(numMembers-1, (size_t)(q.q*numMembers)));
+          std::nth_element(column.begin() + from, column.begin() + k, column.end());
+          (q.upper? out.upper: out.lower)[q.level][i] = central[i] + column[k]*step;
+          from = k;
+        }
+      }
+    }, std::min<unsigned>(workers, columns.size()));
+  } // Ensemble::bands()
+}; // class Ensemble
+
+// Runs an ensemble on its own thread, restarting it whenever new central parameters
+// are posted. Bands are published after every batch, with batches doubling from
+// firstBatch, so a moving slider shows coarse bands at once and they sharpen when it
+// stops.
+class EnsembleWorker {
+  private:
+  Ensemble ensemble;
+  const size_t firstBatch;
+  const size_t maxBatch; // Largest batch, which bounds how long a restart can wait.
+  bool active = false; // Owned by the worker thread.
+
+  BackgroundWorker<OscPars, EnsembleBands> worker;
+
+  bool step() {
+    if(worker.update()) {
+      ensemble.reset(worker.request());
+      active = true;
+    }
+    if(!active || ensemble.done()) return false;
+    const size_t batch = std::min(maxBatch, std::max(firstBatch, ensemble.size()));
+    ensemble.add(batch);
+    // Bands for parameters that have already been replaced would only flicker.
+    if(worker.hasNew()) return true;
+    ensemble.bands(worker.resultSlot());
+    worker.publish();
+    if(ensemble.done()) worker.finish();
+    return true;
+  } // EnsembleWorker::step()
+
+  public:
+  EnsembleWorker(const size_t maxMembers = 10000, const int numsteps = 500,
+                 const std::vector<Prior>& priors = defaultPriors(),
+                 const size_t firstBatch = 256, const size_t maxBatch = 2048):
+    ensemble(maxMembers, numsteps, priors), firstBatch(firstBatch), maxBatch(maxBatch),
+    worker("ensemble", [this] { return step(); }) {}
+
+  // Restart the ensemble around new central parameters.
+  void post(const OscPars& pars) { worker.post(pars); }
+
+  // Whether the bands for the newest parameters are still filling in.
+  bool busy() const { return worker.busy(); }
+
+  // Take the newest bands, if there are any since the last call. Never blocks.
+  bool poll(EnsembleBands& bands) { return worker.poll(bands); }
+}; // class EnsembleWorker
+
+} // namespace neutosc
+
+#endif
@@ -0,0 +1,235 @@
+#include "Export.h"
+#include "AdaptiveSampler.h"
+#include "EarthModel.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+namespace neutosc {
+
+namespace {
+
+// Append a double to a string as the shortest text that reads back to the same value.
+inline void appendNumber(std::string& buffer, const double val) {
+  char tmp[32];
+#if defined(__cpp_lib_to_chars)
+  const std::to_chars_result res = std::to_chars(tmp, tmp + sizeof(tmp), val);
+  buffer.append(tmp, res.ptr);
+#else
+  const int len = std::snprintf(tmp, sizeof(tmp), "%.17g", val);
+  buffer.append(tmp, len);
+#endif
+}
+
+// The binary format is little-endian whatever the host is.
+inline bool bigEndianHost() {
+  const uint16_t one = 1;
+  unsigned char first;
+  std::memcpy(&first, &one, 1);
+  return first == 0;
+}
+
+// Copy a value to dst in little-endian byte order.
+template<typename T>
+inline void storeLE(char* dst, const T val) {
+  std::memcpy(dst, &val, sizeof(T));
+  if(bigEndianHost()) std::reverse(dst, dst + sizeof(T));
+}
+
+template<typename T>
+inline void put(std::vector<char>& bytes, const size_t offset, const T val) {
+  storeLE(bytes.data() + offset, val);
+}
+
+} // namespace
+
+CsvWriter::CsvWriter(const std::string& filename): ofile(filename, std::ios::binary) {
+  if(!ofile.is_open()) {
+    std::cout << "Couldn't create file " << filename << ".\n";
+    return;
+  }
+  // Header.
+  ofile << "x,nue,numu,nutau\n";
+} // CsvWriter::CsvWriter()
+
+void CsvWriter::append(const double* x, const Eigen::Vector3d* probs, const size_t n) {
+  buffer.clear();
+  for(size_t i = 0; i < n; ++i) {
+    appendNumber(buffer, x[i]);
+    for(int b = 0; b < 3; ++b) {
+      buffer.push_back(',');
+      appendNumber(buffer, probs[i](b));
+    }
+    buffer.push_back('\n');
+  }
+  ofile.write(buffer.data(), buffer.size());
+} // CsvWriter::append()
+
+ColumnWriter::ColumnWriter(const std::string& filename, const OscPars& pars, const uint64_t rows,
+                           const Precision precision):
+    ofile(filename, std::ios::binary), rows(rows), valuesize(precision == Precision::Float64? 8: 4) {
+  if(!ofile.is_open()) {
+    std::cout << "Couldn't create file " << filename << ".\n";
+    return;
+  }
+  const char* names[4] = {"x", "nue", "numu", "nutau"};
+  const uint32_t numcols = 4;
+  headersize = (112 + 16*numcols + 63)/64*64;
+
+  std::vector<char> header(headersize, 0);
+  std::memcpy(header.data(), "ENEUCOL1", 8);
+  put<uint32_t>(header, 8, headersize);
+  put<uint32_t>(header, 12, 1);
+  put<uint64_t>(header, 16, rows);
+  put<uint32_t>(header, 24, numcols);
+  put<uint32_t>(header, 28, valuesize);
+  put<int32_t>(header, 32, pars.nu);
+  put<int32_t>(header, 36, pars.anti);
+  const double vals[9] = {pars.E, pars.L, pars.th12, pars.th23, pars.th13,
+                          pars.Dm21sq, pars.Dm31sq, pars.dCP, pars.rho};
+  for(int vi = 0; vi < 9; ++vi) put<double>(header, 40 + 8*vi, vals[vi]);
+  for(uint32_t ci = 0; ci < numcols; ++ci) std::strncpy(header.data() + 112 + 16*ci, names[ci], 15);
+  ofile.write(header.data(), header.size());
+
+  // Reserve the full size so that chunks can be written anywhere.
+  if(rows > 0) {
+    ofile.seekp(headersize + numcols*rows*valuesize - 1);
+    ofile.put(0);
+  }
+} // ColumnWriter::ColumnWriter()
+
+void ColumnWriter::writeColumn(const int col, const double* vals, const size_t n, const size_t stride) {
+  buffer.resize(n*valuesize);
+  for(size_t i = 0; i < n; ++i) {
+    if(valuesize == 8) storeLE<double>(buffer.data() + 8*i, vals[i*stride]);
+    else storeLE<float>(buffer.data() + 4*i, vals[i*stride]);
+  }
+  ofile.seekp(headersize + (col*rows + written)*valuesize);
+  ofile.write(buffer.data(), buffer.size());
+} // ColumnWriter::writeColumn()
+
+void ColumnWriter::append(const double* x, const Eigen::Vector3d* probs, size_t n) {
+  if(!ok() || n == 0) return;
+  n = std::min<uint64_t>(n, rows - written);
+  writeColumn(0, x, n, 1);
+  for(int b = 0; b < 3; ++b) {
+    writeColumn(1+b, probs[0].data() + b, n, 3);
+  }
+  written += n;
+} // ColumnWriter::append()
+
+bool runExport(const ExportJob& job, const std::function<bool(size_t, size_t)>& progress) {
+  PROFILE_SCOPE("runExport");
+  if(!job.which || job.numsteps < 1) return false;
+  Oscillator osc;
+  osc.pars() = job.pars;
+  osc.update();
+  const double final = job.pars.*job.which;
+  const double step = final/job.numsteps;
+  std::unique_ptr<EarthPropagator> earth;
+  if(job.zenith) earth.reset(new EarthPropagator(osc));
+
+  // Adaptive points are computed up front, as their number isn't known in advance.
+  SampledPath<double> adaptive;
+  if(job.tolerance > 0 && !job.zenith) {
+    AdaptiveOptions opts;
+    opts.tolerance = job.tolerance;
+    opts.maxPoints = job.numsteps+1;
+    // A denser start than on screen, so that fast oscillations aren't missed between points.
+    opts.initialPoints = std::min<size_t>(1025, opts.maxPoints);
+    // Progress is in points evaluated out of the budget while refining.
+    bool cancelled = false;
+    if(progress) {
+      opts.progress = [&progress, &cancelled](size_t n, size_t total) {
+        cancelled = !progress(n, total);
+        return !cancelled;
+      };
+    }
+    adaptive = sampleAdaptive(osc, job.which, final, opts, job.engine, job.smearing);
+    if(cancelled) return false;
+    std::cout << adaptive.x.size() << " adaptive points, estimated error " << adaptive.maxError
+              << (adaptive.converged? ".\n": ". Point budget reached before the tolerance, sampled evenly instead.\n");
+  }
+  const size_t numrows = job.tolerance > 0 && !job.zenith? adaptive.x.size(): job.numsteps+1;
+
+  std::unique_ptr<CsvWriter> csv;
+  std::unique_ptr<ColumnWriter> columns;
+  if(job.binary) {
+    columns.reset(new ColumnWriter(job.filename, job.pars, numrows, job.precision));
+    if(!columns->ok()) return false;
+  } else {
+    csv.reset(new CsvWriter(job.filename));
+    if(!csv->ok()) return false;
+  }
+
+  const size_t chunk = 1000;
+  std::vector<double> xs(chunk);
+  std::vector<Eigen::Vector3d> probs(chunk);
+  for(size_t i0 = 0; i0 < numrows; i0 += chunk) {
+    const size_t m = std::min(chunk, numrows-i0);
+    const double* x = xs.data();
+    const Eigen::Vector3d* p = probs.data();
+    if(job.zenith) {
+      for(size_t i = 0; i < m; ++i) xs[i] = -1 + 2.*(i0+i)/job.numsteps;
+      earth->zenithBatch(xs.data(), m, probs.data());
+    } else if(job.tolerance > 0) {
+      x = adaptive.x.data() + i0;
+      p = adaptive.probs.data() + i0;
+    } else {
+      for(size_t i = 0; i < m; ++i) xs[i] = (i0+i)*step;
+      osc.transBatch(xs.data(), m, job.which, probs.data(), job.engine, job.smearing);
+    }
+    if(job.binary) {
+      columns->append(x, p, m);
+    } else {
+      csv->append(x, p, m);
+    }
+    if(progress && !progress(i0 + m, numrows)) return false;
+  }
+  if(!(job.binary? columns->ok(): csv->ok())) {
+    std::cout << "Couldn't write file " << job.filename << ".\n";
+    return false;
+  }
+
+  std::cout << "Saving to " << job.filename << ".\n";
+  if(!job.binary) job.pars.print(job.parfilename);
+  return true;
+} // runExport()
+
+bool writeOscillogram(const Oscillogram& gram, const std::string& filename) {
+  PROFILE_SCOPE("writeOscillogram");
+  std::ofstream ofile(filename, std::ios::binary);
+  if(!ofile.is_open()) {
+    std::cout << "Couldn't create file " << filename << ".\n";
+    return false;
+  }
+  ofile << "E,y,nue,numu,nutau\n";
+  const OscillogramGrid& grid = gram.getGrid();
+  std::string buffer;
+  for(int i = 0; i < grid.nE && ofile.good(); ++i) {
+    // One energy at a time.
+    buffer.clear();
+    for(int j = 0; j < grid.nY; ++j) {
+      appendNumber(buffer, grid.E(i));
+      buffer.push_back(',');
+      appendNumber(buffer, grid.y(j));
+      for(int b = 0; b < 3; ++b) {
+        buffer.push_back(',');
+        appendNumber(buffer, gram(i, j)(b));
+      }
+      buffer.push_back('\n');
+    }
+    ofile.write(buffer.data(), buffer.size());
+  }
+  return ofile.good();
+} // writeOscillogram()
+
+} // namespace neutosc
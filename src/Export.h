@@ -0,0 +1,103 @@
+#ifndef EXPORT_H__
+#define EXPORT_H__
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <functional>
+#include <Eigen/Dense>
+
+#include "NeutOsc.h"
+#include "Oscillogram.h"
+
+namespace neutosc {
+
+// Streaming CSV writer for x,nue,numu,nutau rows. Numbers are formatted into a
+// buffer with std::to_chars where the standard library has it (shortest text that
+// reads back to the same double) and printf otherwise.
+class CsvWriter {
+  private:
+  std::ofstream ofile;
+  std::string buffer;
+
+  public:
+  CsvWriter(const std::string& filename);
+  bool ok() const { return ofile.is_open() && ofile.good(); }
+  // Append n rows.
+  void append(const double* x, const Eigen::Vector3d* probs, const size_t n);
+}; // class CsvWriter
+
+// Binary columnar format (.enb), all values little-endian (swapped on big-endian
+// hosts):
+//
+//   offset  size  contents
+//   0       8     magic "ENEUCOL1"
+//   8       4     uint32 header size in bytes, a multiple of 64
+//   12      4     uint32 format version (1)
+//   16      8     uint64 number of rows
+//   24      4     uint32 number of columns
+//   28      4     uint32 bytes per value: 8 for float64, 4 for float32
+//   32      8     int32 initial flavour, int32 antineutrino flag
+//   40      72    float64 E, L, th12, th23, th13, Dm21sq, Dm31sq, dCP, rho
+//   112     16*n  zero padded column names
+//
+// The columns follow the header back to back, column c starting at
+// header size + c * rows * bytes per value, so each one can be memory-mapped as a
+// plain array. Columns are x, nue, numu and nutau.
+enum class Precision { Float64, Float32 };
+
+// Streaming writer for the binary format. The number of rows is fixed up front so
+// that every chunk can be written straight to its place in each column, and a scan
+// never needs to hold more than one chunk in memory.
+class ColumnWriter {
+  private:
+  std::ofstream ofile;
+  uint64_t rows;
+  uint64_t written = 0;
+  uint32_t headersize;
+  uint32_t valuesize;
+  std::vector<char> buffer;
+
+  void writeColumn(const int col, const double* vals, const size_t n, const size_t stride);
+
+  public:
+  ColumnWriter(const std::string& filename, const OscPars& pars, const uint64_t rows,
+               const Precision precision = Precision::Float64);
+  bool ok() const { return ofile.is_open() && ofile.good(); }
+  uint64_t numWritten() const { return written; }
+  // Append n rows. Rows beyond the declared number are dropped.
+  void append(const double* x, const Eigen::Vector3d* probs, size_t n);
+}; // class ColumnWriter
+
+// Export of probabilities vs one parameter from 0 to its value in pars, or vs the
+// cosine of the zenith angle from -1 to 1 through the layered Earth.
+struct ExportJob {
+  OscPars pars;
+  double OscPars::* which = &OscPars::L;
+  bool zenith = false; // Atmospheric zenith scan at pars.E through PREM, instead of which.
+  // Neither adaptive sampling nor smearing apply to it.
+  int numsteps = 10000;
+  Engine engine = Engine::EigenDecomp;
+  // Sample adaptively to this tolerance, with at most numsteps+1 points, if > 0.
+  double tolerance = 0;
+  Smearing smearing; // Energy resolution and flux to average over, if enabled.
+  bool binary = false; // Binary columns instead of csv. Parameters then go in its header.
+  Precision precision = Precision::Float64;
+  std::string filename = "nu.csv";
+  std::string parfilename = "nuparameters.csv";
+};
+
+// Compute and write an export in chunks, so that only one chunk is ever in memory.
+// progress(done, total) is called after each chunk and stops the export by returning false.
+// Returns true if the whole file was written.
+bool runExport(const ExportJob& job,
+               const std::function<bool(size_t, size_t)>& progress = std::function<bool(size_t, size_t)>());
+
+// Write an oscillogram as E,y,nue,numu,nutau csv rows, one energy after another, with y
+// the baseline or cos(zenith). Returns true if the whole file was written.
+bool writeOscillogram(const Oscillogram& gram, const std::string& filename);
+
+} // namespace neutosc
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef EXPORTQUEUE_H__
+#define EXPORTQUEUE_H__
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "NeutOsc.h"
+#include "Export.h"
+
+namespace neutosc {
+
+// Runs exports one after the other on a worker thread so that the window keeps drawing.
+class ExportQueue {
+  private:
+  std::deque<ExportJob> jobs;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<bool> quit;
+
+  // Progress of the running job, in points.
+  std::atomic<int> done;
+  std::atomic<int> total;
+  std::atomic<int> pending; // Queued plus running jobs.
+  int numexports = 0; // For numbering output files.
+
+  std::thread worker;
+
+  void run() {
+    PROFILE_THREAD("export");
+    while(true) {
+      ExportJob job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return quit || !jobs.empty(); });
+        if(quit) return;
+        job = jobs.front();
+        jobs.pop_front();
+      }
+      process(job);
+      --pending;
+    }
+  } // ExportQueue::run()
+
+  void process(const ExportJob& job) {
+    done = 0;
+    total = job.numsteps+1;
+    // An adaptive export reports against its point budget while refining, then
+    // against the number of points it ended up with while writing them.
+    runExport(job, [this](size_t n, size_t of) {
+      total = (int)of;
+      done = (int)n;
+      return !quit;
+    });
+  } // ExportQueue::process()
+
+  public:
+  ExportQueue(): quit(false), done(0), total(0), pending(0) {
+    worker = std::thread(&ExportQueue::run, this);
+  }
+
+  // Stops after the running job's current chunk. Jobs still queued are dropped.
+  ~ExportQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    cv.notify_one();
+    worker.join();
+  }
+
+  // Queue an export. Files after the first are numbered so that queued exports don't overwrite each other.
+  void push(ExportJob job) {
+    if(!job.which) return;
+    if(numexports > 0) {
+      const std::string suffix = "_" + std::to_string(numexports+1);
+      for(std::string* name : {&job.filename, &job.parfilename}) {
+        const size_t dot = name->find_last_of('.');
+        name->insert(dot == std::string::npos? name->size(): dot, suffix);
+      }
+    }
+    ++numexports;
+    ++pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(job);
+    }
+    cv.notify_one();
+  } // ExportQueue::push()
+
+  // Number of jobs that are queued or running.
+  int numPending() const { return pending; }
+  bool busy() const { return pending > 0; }
+  // Fraction of the running job that is done.
+  double progress() const { return total > 0? (double)done/total: 0; }
+}; // class ExportQueue
+
+} // namespace neutosc
+
+#endif
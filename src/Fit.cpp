@@ -0,0 +1,249 @@
+#include "Fit.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <Eigen/Dense>
+
+namespace neutosc {
+
+bool Spectrum::read(const std::string& filename) {
+  std::ifstream ifile(filename);
+  if(!ifile.is_open()) {
+    std::cerr << "Could not open file " << filename << ".\n";
+    return false;
+  }
+
+  bins.clear();
+  std::string line;
+  int linenum = 0;
+  while(std::getline(ifile, line)) {
+    ++linenum;
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    if(line.empty() || line.compare(0, 5, "E min") == 0) continue;
+    std::vector<double> vals;
+    std::istringstream fields(line);
+    std::string field;
+    try {
+      while(std::getline(fields, field, ',')) {
+        size_t used = 0;
+        vals.push_back(std::stod(field, &used));
+        if(field.find_first_not_of(" \t", used) != std::string::npos) throw std::invalid_argument(field);
+      }
+    } catch(const std::exception&) {
+      vals.clear();
+    }
+    if(vals.size() != 8) {
+      std::cerr << filename << ":" << linenum << ": expected 8 numbers.\n";
+      return false;
+    }
+    const SpectrumBin bin{vals[0], vals[1], vals[2], (int)vals[3], (int)vals[4], vals[5] != 0, vals[6], vals[7]};
+    if(!(bin.Emin > 0 && bin.Emax >= bin.Emin)) {
+      std::cerr << filename << ":" << linenum << ": energies must be positive and in order.\n";
+      return false;
+    }
+    if(bin.initial < 0 || bin.initial > 2 || bin.final < 0 || bin.final > 2) {
+      std::cerr << filename << ":" << linenum << ": flavours must be 0, 1 or 2.\n";
+      return false;
+    }
+    if(!(bin.error > 0)) {
+      std::cerr << filename << ":" << linenum << ": error must be positive.\n";
+      return false;
+    }
+    bins.push_back(bin);
+  }
+  return true;
+} // Spectrum::read()
+
+namespace {
+
+const char* const fitParNames[] = {"th12", "th23", "th13", "dCP", "Dm21sq", "Dm31sq"}; // jacobianPars() order.
+
+// Column of a parameter in the Jacobians of the engine.
+int jacobianColumn(double OscPars::* which) {
+  for(int col = 0; col < (int)jacobianPars().size(); ++col) {
+    if(jacobianPars()[col] == which) return col;
+  }
+  return -1;
+}
+
+// Keep a trial value in range: dCP wraps around, and the mixing angles stop at 0 and
+// pi/2, beyond which they only repeat the physics of the range.
+double constrain(double OscPars::* which, const double val) {
+  const double pi = 3.14159265358979323846;
+  if(which == &OscPars::dCP) {
+    const double wrapped = std::fmod(val, 2*pi);
+    return wrapped < 0? wrapped + 2*pi: wrapped;
+  }
+  if(which == &OscPars::th12 || which == &OscPars::th23 || which == &OscPars::th13) {
+    return std::min(std::max(val, 0.0), pi/2);
+  }
+  return val;
+} // constrain()
+
+// Residuals of all bins, (model - value)/error, and their derivatives by the free
+// parameters, one row per bin. Workers keep their oscillators and buffers between
+// evaluations, and go through the bins sorted by the antineutrino flag so that they
+// rarely need to update() within a chunk.
+class SpectrumModel {
+  private:
+  const Spectrum& data;
+  std::vector<int> columns;
+  int samples;
+  unsigned workers;
+  std::vector<size_t> order;
+  std::vector<Oscillator> oscs;
+  std::vector<std::vector<double>> energies;
+  std::vector<std::vector<Oscillator::Vector3>> probs;
+  std::vector<std::vector<Oscillator::Jacobian>> jacs;
+
+  public:
+  SpectrumModel(const Spectrum& data, const std::vector<double OscPars::*>& free, const int samples,
+                const unsigned workers):
+    data(data), samples(std::max(1, samples)), workers(std::max(1u, workers)), order(data.bins.size()),
+    oscs(this->workers), energies(this->workers, std::vector<double>(this->samples)),
+    probs(this->workers, std::vector<Oscillator::Vector3>(this->samples)),
+    jacs(this->workers, std::vector<Oscillator::Jacobian>(this->samples)) {
+    for(double OscPars::* which : free) columns.push_back(jacobianColumn(which));
+    for(size_t bi = 0; bi < order.size(); ++bi) order[bi] = bi;
+    std::stable_sort(order.begin(), order.end(), [&data](const size_t a, const size_t b) {
+      return data.bins[a].anti < data.bins[b].anti;
+    });
+  }
+
+  void evaluate(const OscPars& pars, Eigen::VectorXd& r, Eigen::MatrixXd& J) {
+    PROFILE_SCOPE("SpectrumModel::evaluate");
+    r.resize(data.bins.size());
+    J.resize(data.bins.size(), columns.size());
+    parallelFor(order.size(), 16, [&](const unsigned wi, const size_t i0, const size_t i1) {
+      Oscillator& osc = oscs[wi];
+      osc.pars() = pars;
+      bool updated = false;
+      for(size_t i = i0; i < i1; ++i) {
+        const size_t bi = order[i];
+        const SpectrumBin& bin = data.bins[bi];
+        if(!updated || osc.pars().anti != bin.anti) {
+          osc.pars().anti = bin.anti;
+          osc.update();
+          updated = true;
+        }
+        osc.pars().nu = bin.initial;
+        osc.pars().L = bin.L;
+        // Midpoints of equal parts of the bin.
+        const int m = bin.Emax > bin.Emin? samples: 1;
+        for(int s = 0; s < m; ++s) energies[wi][s] = bin.Emin + (bin.Emax - bin.Emin)*(s + 0.5)/m;
+        osc.transJacobianBatch(energies[wi].data(), m, &OscPars::E, probs[wi].data(), jacs[wi].data());
+        double p = 0;
+        for(int s = 0; s < m; ++s) p += probs[wi][s](bin.final);
+        r(bi) = (p/m - bin.value)/bin.error;
+        for(size_t fi = 0; fi < columns.size(); ++fi) {
+          double d = 0;
+          for(int s = 0; s < m; ++s) d += jacs[wi][s](bin.final, columns[fi]);
+          J(bi, fi) = d/m/bin.error;
+        }
+      }
+    }, workers);
+  } // SpectrumModel::evaluate()
+}; // class SpectrumModel
+
+} // namespace
+
+const char* fitParName(double OscPars::* which) {
+  const int col = jacobianColumn(which);
+  return col < 0? "": fitParNames[col];
+}
+
+double OscPars::* fitParameter(const std::string& name) {
+  for(size_t col = 0; col < jacobianPars().size(); ++col) {
+    if(name == fitParNames[col]) return jacobianPars()[col];
+  }
+  return nullptr;
+}
+
+void FitResult::print(std::ostream& os) const {
+  for(size_t fi = 0; fi < free.size(); ++fi) {
+    os << fitParName(free[fi]) << " = " << pars.*free[fi] << " +- " << errors[fi] << "\n";
+  }
+  os << "chi2 = " << chi2 << " for " << ndof << " degrees of freedom, from " << initialChi2 << ", after "
+     << iterations << " iterations" << (converged? "": " (not converged)") << ".\n";
+} // FitResult::print()
+
+FitResult fitSpectrum(const Spectrum& data, const OscPars& start, const FitOptions& options) {
+  PROFILE_SCOPE("fitSpectrum");
+  for(double OscPars::* which : options.free) {
+    if(jacobianColumn(which) < 0) throw std::invalid_argument("Only th12, th23, th13, dCP, Dm21sq and Dm31sq can be fitted.");
+  }
+  FitResult result;
+  result.pars = start;
+  result.free = options.free;
+  const size_t numfree = options.free.size();
+  result.ndof = (int)data.bins.size() - (int)numfree;
+  result.errors.assign(numfree, std::numeric_limits<double>::quiet_NaN());
+  if(data.bins.empty()) return result;
+
+  SpectrumModel model(data, options.free, options.samplesPerBin, options.workers);
+  Eigen::VectorXd r, rtrial;
+  Eigen::MatrixXd J, Jtrial;
+  model.evaluate(result.pars, r, J);
+  ++result.evaluations;
+  result.chi2 = result.initialChi2 = r.squaredNorm();
+  if(numfree == 0) {
+    result.converged = true;
+    return result;
+  }
+
+  // Steps solve (JtJ + lambda*diag(JtJ)) step = -Jt r, which goes from Gauss-Newton
+  // to gradient descent scaled per parameter as lambda grows. Lambda shrinks after a
+  // step that lowers chi^2 and grows until one does.
+  double lambda = 1e-3;
+  while(!result.converged && result.iterations < options.maxIterations) {
+    ++result.iterations;
+    const Eigen::MatrixXd A = J.transpose()*J;
+    const Eigen::VectorXd g = J.transpose()*r;
+    bool stepped = false;
+    while(!stepped && lambda < 1e12) {
+      Eigen::MatrixXd N = A;
+      for(size_t fi = 0; fi < numfree; ++fi) N(fi,fi) += lambda*std::max(A(fi,fi), 1e-300);
+      const Eigen::VectorXd step = N.ldlt().solve(-g);
+      OscPars trial = result.pars;
+      bool tiny = true;
+      for(size_t fi = 0; fi < numfree; ++fi) {
+        double OscPars::* which = options.free[fi];
+        trial.*which = constrain(which, trial.*which + step(fi));
+        // Negligible next to both the value and the resolution, 1/sqrt of the curvature,
+        // so that parameters near 0 converge too. A wrap of dCP isn't a move.
+        const double moved = which == &OscPars::dCP? step(fi): trial.*which - result.pars.*which;
+        const double scale = std::abs(result.pars.*which) + 1/std::sqrt(std::max(A(fi,fi), 1e-300));
+        tiny = tiny && std::abs(moved) <= options.tolerance*scale;
+      }
+      model.evaluate(trial, rtrial, Jtrial);
+      ++result.evaluations;
+      const double chi2 = rtrial.squaredNorm();
+      if(chi2 < result.chi2) {
+        result.converged = tiny || result.chi2 - chi2 <= options.tolerance*result.chi2;
+        result.pars = trial;
+        result.chi2 = chi2;
+        std::swap(r, rtrial);
+        std::swap(J, Jtrial);
+        lambda = std::max(lambda/10, 1e-12);
+        stepped = true;
+      } else {
+        lambda *= 10;
+      }
+    }
+    // No step, however short, lowers chi^2: the minimum is as good as it gets.
+    if(!stepped) result.converged = true;
+  }
+
+  // Errors from the inverse of the curvature, JtJ for a chi^2 of residuals over errors.
+  const Eigen::MatrixXd A = J.transpose()*J;
+  const Eigen::MatrixXd cov = A.ldlt().solve(Eigen::MatrixXd::Identity(numfree, numfree));
+  for(size_t fi = 0; fi < numfree; ++fi) {
+    if(cov(fi,fi) > 0) result.errors[fi] = std::sqrt(cov(fi,fi));
+  }
+  return result;
+} // fitSpectrum()
+
+} // namespace neutosc
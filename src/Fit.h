@@ -0,0 +1,82 @@
+#ifndef FIT_H__
+#define FIT_H__
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "NeutOsc.h"
+#include "Parallel.h"
+
+namespace neutosc {
+
+// One bin of a measured spectrum: the oscillation probability from an initial to a
+// final flavour, averaged over energies from Emin to Emax at baseline L.
+struct SpectrumBin {
+  double Emin; // In GeV.
+  double Emax;
+  double L; // In km.
+  int initial; // 0=e, 1=mu, 2=tau
+  int final;
+  bool anti;
+  double value;
+  double error; // 1 sigma, > 0.
+};
+
+// Binned probabilities (rates over their unoscillated prediction) to fit to, read
+// from a csv file with the columns
+//
+//   E min [GeV],E max [GeV],L [km],Initial flavour,Final flavour,Antineutrino [bool],Probability,Error
+//
+// and one bin per line. Emin == Emax makes a bin a single energy.
+struct Spectrum {
+  std::vector<SpectrumBin> bins;
+
+  // Returns false if the file can't be opened or has a malformed line.
+  bool read(const std::string& filename);
+};
+
+// Parameters a fit can free, with their names in files and on the command line:
+// those of jacobianPars().
+const char* fitParName(double OscPars::* which);
+// The parameter of a name, or nullptr if it isn't one of the above.
+double OscPars::* fitParameter(const std::string& name);
+// What a long-baseline appearance and disappearance spectrum constrains.
+inline std::vector<double OscPars::*> defaultFitPars() {
+  return {&OscPars::th23, &OscPars::dCP, &OscPars::Dm31sq};
+}
+
+struct FitOptions {
+  std::vector<double OscPars::*> free = defaultFitPars(); // From jacobianPars().
+  int samplesPerBin = 8; // Energies averaged over in each bin that has a width.
+  int maxIterations = 100;
+  // Stop when chi^2 improves by less than this, relatively, or when no parameter moves
+  // by more than this times its value plus its resolution.
+  double tolerance = 1e-8;
+  unsigned workers = numWorkers();
+};
+
+struct FitResult {
+  OscPars pars; // Best fit. The parameters that weren't free are those started from.
+  std::vector<double OscPars::*> free;
+  std::vector<double> errors; // 1 sigma, from the curvature of chi^2 at the best fit.
+  double initialChi2 = 0;
+  double chi2 = 0;
+  int ndof = 0;
+  int iterations = 0;
+  int evaluations = 0; // Of chi^2 and its derivatives over all bins.
+  bool converged = false;
+
+  // Table of the free parameters with their errors, and the chi^2.
+  void print(std::ostream& os) const;
+};
+
+// Minimise the chi^2 of the spectrum over the free parameters with Levenberg-Marquardt,
+// starting from start. Bins are evaluated over all cores, each through one batched
+// energy sweep of the engine with analytic derivatives. Throws std::invalid_argument
+// if a free parameter isn't one of jacobianPars().
+FitResult fitSpectrum(const Spectrum& data, const OscPars& start, const FitOptions& options = FitOptions());
+
+} // namespace neutosc
+
+#endif
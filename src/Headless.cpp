@@ -0,0 +1,272 @@
+#include "Headless.h"
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <memory>
+
+#include "NeutOsc.h"
+#include "Export.h"
+#include "Oscillogram.h"
+#include "Fit.h"
+
+namespace neutosc {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void usage(const char* name) {
+  std::cerr << "Usage: " << name << " --headless [options]\n"
+            << "  --scan PAR      parameter to scan from 0 to its value: L (default), E, th12, th23,\n"
+            << "                  th13, Dm21sq, Dm31sq, dCP or rho, or cosz for the cosine of the\n"
+            << "                  zenith angle from -1 to 1 through the PREM Earth at the energy E\n"
+            << "  --steps N       number of steps, e.g. 1e6 (default 10000)\n"
+            << "  --params FILE   parameters in the format of nuparameters.csv (default built-in)\n"
+            << "  --out FILE      output file (default nu.csv, or nu.enb for binary formats)\n"
+            << "  --format FMT    csv (default), f64 or f32 binary columns\n"
+            << "  --engine ENG    matter propagation: eigen (default), exp or lie\n"
+            << "  --adaptive TOL  sample adaptively to within TOL in probability, using at most\n"
+            << "                  steps+1 points\n"
+            << "  --smear S:W     average over an energy resolution of shape S, gauss or box, and\n"
+            << "                  relative width W in L/E, e.g. gauss:0.05\n"
+            << "  --flux FILE     average over the beam spectrum in FILE, with E [GeV],Flux columns\n"
+            << "  --oscillogram Y instead of a scan, write E,y,nue,numu,nutau rows over E from 0.5 to\n"
+            << "                  8 GeV and Y: L from 0 to its value, or cosz from -1 to 1 through\n"
+            << "                  the PREM Earth\n"
+            << "  --grid N        oscillogram points along each axis (default 500)\n"
+            << "  --fit FILE      instead of exporting, fit the parameters to the spectrum in FILE and\n"
+            << "                  write them to --out (default fit_parameters.csv)\n"
+            << "  --free LIST     comma separated parameters to fit, from th12, th23, th13, dCP,\n"
+            << "                  Dm21sq and Dm31sq (default th23,dCP,Dm31sq)\n";
+}
+
+double OscPars::* parameter(const std::string& name) {
+  const std::pair<const char*, double OscPars::*> names[] = {
+    {"E", &OscPars::E}, {"L", &OscPars::L}, {"th12", &OscPars::th12}, {"th23", &OscPars::th23},
+    {"th13", &OscPars::th13}, {"Dm21sq", &OscPars::Dm21sq}, {"Dm31sq", &OscPars::Dm31sq},
+    {"dCP", &OscPars::dCP}, {"rho", &OscPars::rho}
+  };
+  for(const auto& n : names) {
+    if(name == n.first) return n.second;
+  }
+  return nullptr;
+}
+
+// Fit the free parameters to a spectrum, starting from pars, and write the best fit.
+int runFit(const OscPars& pars, const std::string& spectrum, const FitOptions& options,
+           const std::string& out, const Clock::time_point start) {
+  Spectrum data;
+  if(!data.read(spectrum)) return HeadlessParams;
+  std::cerr << "Startup " << millisecondsSince(start) << " ms.\n";
+
+  const Clock::time_point fitstart = Clock::now();
+  const FitResult result = fitSpectrum(data, pars, options);
+  result.print(std::cout);
+  std::cerr << "Fitted " << data.bins.size() << " bins in " << millisecondsSince(fitstart) << " ms, "
+            << result.evaluations << " evaluations.\n";
+  if(!result.pars.print(out)) return HeadlessOutput;
+  return HeadlessOk;
+} // runFit()
+
+// Compute an oscillogram for the job's parameters and engine and write it as csv.
+int runOscillogram(const ExportJob& job, OscillogramGrid grid, const Clock::time_point start) {
+  if(grid.axis == Axis::L) {
+    grid.ymin = 0;
+    grid.ymax = job.pars.L;
+  } else {
+    grid.ymin = -1;
+    grid.ymax = 1;
+  }
+  Oscillator osc;
+  osc.pars() = job.pars;
+  osc.update();
+  Oscillogram gram(grid);
+  std::cerr << "Startup " << millisecondsSince(start) << " ms.\n";
+
+  const Clock::time_point computestart = Clock::now();
+  gram.compute(osc, job.engine);
+  std::cerr << "Computed " << grid.size() << " points in " << millisecondsSince(computestart) << " ms.\n";
+  if(!writeOscillogram(gram, job.filename) || !job.pars.print(job.parfilename)) {
+    std::cerr << "Couldn't write " << job.filename << ".\n";
+    return HeadlessOutput;
+  }
+  std::cerr << "Wrote " << job.filename << ", " << millisecondsSince(start) << " ms total.\n";
+  return HeadlessOk;
+} // runOscillogram()
+
+} // namespace
+
+bool isHeadless(int argc, char* argv[]) {
+  for(int i = 1; i < argc; ++i) {
+    if(std::strcmp(argv[i], "--headless") == 0) return true;
+  }
+  return false;
+} // isHeadless()
+
+int runHeadless(int argc, char* argv[]) {
+  const Clock::time_point start = Clock::now();
+
+  ExportJob job;
+  FitOptions fit;
+  OscillogramGrid grid;
+  grid.nE = grid.nY = 500;
+  bool oscillogram = false;
+  std::string params, out, format = "csv", spectrum;
+  for(int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if(arg == "--headless") continue;
+    if(arg == "--help" || arg == "-h") {
+      usage(argv[0]);
+      return HeadlessOk;
+    }
+    if(i+1 >= argc) {
+      std::cerr << "Unknown option or missing value: " << arg << "\n";
+      usage(argv[0]);
+      return HeadlessUsage;
+    }
+    const std::string val = argv[++i];
+    if(arg == "--scan") {
+      job.zenith = val == "cosz";
+      job.which = job.zenith? &OscPars::L: parameter(val);
+      if(!job.which) {
+        std::cerr << "Unknown parameter " << val << ".\n";
+        return HeadlessUsage;
+      }
+    } else if(arg == "--steps") {
+      // Parsed as a double so that 1e6 works.
+      double steps = 0;
+      try {
+        size_t used = 0;
+        steps = std::stod(val, &used);
+        if(used != val.size()) steps = 0;
+      } catch(const std::exception&) {}
+      if(!(steps >= 1 && steps < 2147483647.) || steps != std::floor(steps)) {
+        std::cerr << "Number of steps must be a positive integer, got " << val << ".\n";
+        return HeadlessUsage;
+      }
+      job.numsteps = (int)steps;
+    } else if(arg == "--params") {
+      params = val;
+    } else if(arg == "--out") {
+      out = val;
+    } else if(arg == "--format") {
+      format = val;
+      if(format != "csv" && format != "f64" && format != "f32") {
+        std::cerr << "Unknown format " << val << ".\n";
+        return HeadlessUsage;
+      }
+    } else if(arg == "--adaptive") {
+      double tol = 0;
+      try {
+        tol = std::stod(val);
+      } catch(const std::exception&) {}
+      if(!(tol > 0)) {
+        std::cerr << "Adaptive tolerance must be positive, got " << val << ".\n";
+        return HeadlessUsage;
+      }
+      job.tolerance = tol;
+    } else if(arg == "--smear") {
+      const size_t colon = val.find(':');
+      const std::string shape = val.substr(0, colon);
+      double width = 0;
+      try {
+        if(colon != std::string::npos) width = std::stod(val.substr(colon+1));
+      } catch(const std::exception&) {}
+      if((shape != "gauss" && shape != "box") || !(width > 0)) {
+        std::cerr << "Smearing must be gauss:WIDTH or box:WIDTH with a positive width, got " << val << ".\n";
+        return HeadlessUsage;
+      }
+      job.smearing.shape = shape == "box"? Resolution::Box: Resolution::Gaussian;
+      job.smearing.width = width;
+    } else if(arg == "--flux") {
+      std::shared_ptr<FluxSpectrum> flux(new FluxSpectrum);
+      if(!flux->read(val)) return HeadlessParams;
+      job.smearing.flux = flux;
+    } else if(arg == "--oscillogram") {
+      oscillogram = true;
+      if(val == "L") grid.axis = Axis::L;
+      else if(val == "cosz") grid.axis = Axis::CosZenith;
+      else {
+        std::cerr << "Oscillogram axis must be L or cosz, got " << val << ".\n";
+        return HeadlessUsage;
+      }
+    } else if(arg == "--grid") {
+      int n = 0;
+      try {
+        size_t used = 0;
+        n = std::stoi(val, &used);
+        if(used != val.size()) n = 0;
+      } catch(const std::exception&) {}
+      if(n < 1) {
+        std::cerr << "Grid size must be a positive integer, got " << val << ".\n";
+        return HeadlessUsage;
+      }
+      grid.nE = grid.nY = n;
+    } else if(arg == "--fit") {
+      spectrum = val;
+    } else if(arg == "--free") {
+      fit.free.clear();
+      std::string name;
+      for(size_t from = 0; from <= val.size(); from += name.size() + 1) {
+        name = val.substr(from, val.find(',', from) - from);
+        fit.free.push_back(fitParameter(name));
+        if(!fit.free.back()) {
+          std::cerr << "Can't fit parameter " << name << ".\n";
+          return HeadlessUsage;
+        }
+      }
+    } else if(arg == "--engine") {
+      if(val == "eigen") job.engine = Engine::EigenDecomp;
+      else if(val == "exp") job.engine = Engine::MatrixExp;
+      else if(val == "lie") job.engine = Engine::LieProduct;
+      else {
+        std::cerr << "Unknown engine " << val << ".\n";
+        return HeadlessUsage;
+      }
+    } else {
+      std::cerr << "Unknown option " << arg << ".\n";
+      usage(argv[0]);
+      return HeadlessUsage;
+    }
+  }
+
+  if(job.zenith && (job.tolerance > 0 || job.smearing.enabled())) {
+    std::cerr << "Zenith scans are sampled evenly and without smearing.\n";
+    return HeadlessUsage;
+  }
+  if(oscillogram && (format != "csv" || job.tolerance > 0 || job.smearing.enabled())) {
+    std::cerr << "Oscillograms are written as csv, evenly sampled and without smearing.\n";
+    return HeadlessUsage;
+  }
+  if(!params.empty() && !job.pars.read(params)) return HeadlessParams;
+  if(!spectrum.empty()) return runFit(job.pars, spectrum, fit, out.empty()? "fit_parameters.csv": out, start);
+  job.binary = format != "csv";
+  job.precision = format == "f32"? Precision::Float32: Precision::Float64;
+  job.filename = !out.empty()? out: job.binary? "nu.enb": "nu.csv";
+  // The parameter file goes next to the output.
+  if(!job.binary) {
+    const size_t dot = job.filename.find_last_of('.');
+    const size_t slash = job.filename.find_last_of('/');
+    const bool hasext = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+    job.parfilename = job.filename.substr(0, hasext? dot: job.filename.size()) + "_parameters.csv";
+  }
+  if(oscillogram) return runOscillogram(job, grid, start);
+  std::cerr << "Startup " << millisecondsSince(start) << " ms.\n";
+
+  const Clock::time_point scanstart = Clock::now();
+  if(!runExport(job)) {
+    std::cerr << "Couldn't write " << job.filename << ".\n";
+    return HeadlessOutput;
+  }
+  std::cerr << "Wrote " << job.filename << " in " << millisecondsSince(scanstart) << " ms, "
+            << millisecondsSince(start) << " ms total.\n";
+  return HeadlessOk;
+} // runHeadless()
+
+} // namespace neutosc
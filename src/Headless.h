@@ -0,0 +1,37 @@
+#ifndef HEADLESS_H__
+#define HEADLESS_H__
+
+// Command line batch mode. Runs exports with the neutosc engine only, without
+// creating a window, GL context or loading textures, so it works on machines
+// without a display. Built into the viewer, run with --headless, and on its own as
+// eigenneut-headless, which needs neither SFML nor OpenGL to load.
+//
+//   eigenneut --headless [--scan L|E|th12|th23|th13|Dm21sq|Dm31sq|dCP|rho]
+//             [--steps N] [--params FILE] [--out FILE] [--format csv|f64|f32]
+//             [--engine eigen|exp|lie] [--smear gauss|box:WIDTH] [--flux FILE]
+//   eigenneut --headless --fit SPECTRUM [--free th23,dCP,Dm31sq] [--params FILE] [--out FILE]
+//
+// The second form fits parameters to a measured spectrum (see neutosc::Spectrum) and
+// writes the best fit in the format of nuparameters.csv.
+//
+// Exit codes are listed in HeadlessExit.
+
+namespace neutosc {
+
+enum HeadlessExit {
+  HeadlessOk = 0,
+  HeadlessUsage = 1, // Bad command line.
+  HeadlessParams = 2, // Parameter, spectrum or flux file missing or malformed.
+  HeadlessOutput = 3 // Output file couldn't be written.
+};
+
+// True if --headless is among the arguments.
+bool isHeadless(int argc, char* argv[]);
+
+// Run the export or fit described by the arguments and return one of HeadlessExit.
+// Startup and run times are reported on stderr.
+int runHeadless(int argc, char* argv[]);
+
+} // namespace neutosc
+
+#endif
@@ -0,0 +1,7 @@
+#include "Headless.h"
+
+// eigenneut-headless: the batch mode on its own, linked against neutosc only, so it
+// runs on machines without SFML, OpenGL or a display. --headless is optional here.
+int main(int argc, char *argv[]) {
+  return neutosc::runHeadless(argc, argv);
+}
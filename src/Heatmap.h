@@ -0,0 +1,186 @@
+#ifndef HEATMAP_H__
+#define HEATMAP_H__
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "NeutOsc.h"
+#include "Parallel.h"
+#include "PhysicsWorker.h"
+
+namespace neutosc {
+
+// 2D histogram of probability vectors, laid out like the ternary plot: e at the top
+// corner, mu at the bottom right and tau at the bottom left, with the same linear map
+// as TernaryGraph::TriPoint(). Row 0 is the top. Drawing it costs the same however
+// many points went in.
+class TernaryHistogram {
+  private:
+  int width;
+  int height;
+  std::vector<uint32_t> counts;
+  uint64_t total = 0;
+  std::vector<std::vector<uint32_t>> partial; // Per-worker counts, kept between calls.
+
+  static constexpr float triHeight = 0.8660254f; // Of a triangle with unit sides.
+
+  public:
+  TernaryHistogram(const int width = 512):
+    width(width), height(std::max(1, (int)std::lround(width*triHeight))), counts((size_t)width*height, 0) {}
+
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+  const std::vector<uint32_t>& data() const { return counts; }
+  uint64_t numPoints() const { return total; }
+  uint32_t maxCount() const { return counts.empty()? 0: *std::max_element(counts.begin(), counts.end()); }
+
+  void clear() {
+    std::fill(counts.begin(), counts.end(), 0);
+    total = 0;
+  }
+
+  // Bin of a probability vector. Probabilities are clamped onto the triangle's box.
+  size_t bin(const Eigen::Vector3f& p) const {
+    const int col = std::min(width-1, std::max(0, (int)((p(1) + 0.5f*p(0))*width)));
+    const int row = std::min(height-1, std::max(0, (int)((1 - p(0))*height)));
+    return (size_t)row*width + col;
+  }
+  // Probabilities at the centre of a bin. Outside the triangle some are negative.
+  Eigen::Vector3f centre(const int row, const int col) const {
+    const float e = 1 - (row + 0.5f)/height;
+    const float mu = (col + 0.5f)/width - 0.5f*e;
+    return Eigen::Vector3f(e, mu, 1 - e - mu);
+  }
+
+  template<typename Vector3>
+  void fill(const Vector3* probs, const size_t n) {
+    for(size_t i = 0; i < n; ++i) ++counts[bin(probs[i].template cast<float>())];
+    total += n;
+  }
+
+  // Add a sweep of one parameter from 0 to final in numpoints even steps. Only every
+  // numpasses-th point is taken, starting at pass, so a sweep can be added in parts
+  // that each cover all of it. Chunks of points are spread over all cores, each worker
+  // with its own oscillator and counts, which are summed at the end.
+  template<typename Scalar>
+  void accumulate(const BasicOscillator<Scalar>& osc, double OscPars::* which, const double final,
+                  const size_t numpoints, const size_t pass = 0, const size_t numpasses = 1,
+                  const Engine engine = Engine::EigenDecomp, const unsigned workers = numWorkers()) {
+    PROFILE_SCOPE("TernaryHistogram::accumulate");
+    typedef typename BasicOscillator<Scalar>::Vector3 Vector3;
+    if(numpoints < 2 || pass >= numpasses) return;
+    const size_t n = (numpoints - pass + numpasses - 1)/numpasses; // Points in this pass.
+    const size_t chunk = 4096;
+    const unsigned numworkers = std::max(1u, (unsigned)std::min<size_t>(workers, (n + chunk - 1)/chunk));
+    partial.resize(numworkers);
+    for(std::vector<uint32_t>& part : partial) part.assign(counts.size(), 0);
+    std::vector<BasicOscillator<Scalar>> oscs(numworkers, osc);
+    std::vector<std::vector<double>> xs(numworkers, std::vector<double>(chunk));
+    std::vector<std::vector<Vector3>> probs(numworkers, std::vector<Vector3>(chunk));
+
+    parallelFor(n, chunk, [&](const unsigned wi, const size_t i0, const size_t i1) {
+      const size_t m = i1 - i0;
+      for(size_t i = 0; i < m; ++i) xs[wi][i] = final*((i0+i)*numpasses + pass)/(numpoints - 1);
+      oscs[wi].transBatch(xs[wi].data(), m, which, probs[wi].data(), engine);
+      uint32_t* part = partial[wi].data();
+      for(size_t i = 0; i < m; ++i) ++part[bin(probs[wi][i].template cast<float>())];
+    }, numworkers);
+
+    for(const std::vector<uint32_t>& part : partial) {
+      for(size_t b = 0; b < counts.size(); ++b) counts[b] += part[b];
+    }
+    total += n;
+  } // TernaryHistogram::accumulate()
+
+  // RGBA image of the counts, row by row from the top. Brightness and opacity go with
+  // the log of the count relative to the fullest bin, and the hue with the bin's
+  // probabilities, like the colours of the plotted paths.
+  void toneMap(std::vector<uint8_t>& rgba) const {
+    PROFILE_SCOPE("TernaryHistogram::toneMap");
+    rgba.assign(counts.size()*4, 0);
+    const uint32_t maxcount = maxCount();
+    if(maxcount == 0) return;
+    const float scale = 1/std::log1p((float)maxcount);
+    for(int row = 0; row < height; ++row) {
+      for(int col = 0; col < width; ++col) {
+        const size_t b = (size_t)row*width + col;
+        if(counts[b] == 0) continue;
+        const float level = std::log1p((float)counts[b])*scale;
+        const Eigen::Vector3f p = centre(row, col).cwiseMax(0.f);
+        const float pmax = std::max(p.maxCoeff(), 1e-6f);
+        uint8_t* px = rgba.data() + 4*b;
+        px[0] = (uint8_t)(255*p(2)/pmax);
+        px[1] = (uint8_t)(255*p(0)/pmax);
+        px[2] = (uint8_t)(255*p(1)/pmax);
+        px[3] = (uint8_t)(255*level);
+      }
+    }
+  } // TernaryHistogram::toneMap()
+}; // class TernaryHistogram
+
+// Fills a histogram of an L sweep on its own thread, restarting whenever new parameters
+// are posted. The sweep is added in interleaved passes, and the tone-mapped image is
+// published after each one, so the heatmap shows the whole sweep at once and fills in.
+class HeatmapWorker {
+  public:
+  struct Result {
+    OscPars pars;
+    uint64_t numPoints = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba;
+  };
+
+  private:
+  TernaryHistogram histogram;
+  const size_t numpoints;
+  const size_t numpasses;
+
+  // Owned by the worker thread.
+  OscillatorF osc;
+  size_t pass; // Nothing to do until the first request.
+
+  BackgroundWorker<OscPars, Result> worker;
+
+  bool step() {
+    if(worker.update()) {
+      osc.pars() = worker.request();
+      osc.update();
+      histogram.clear();
+      pass = 0;
+    }
+    if(pass >= numpasses) return false;
+    histogram.accumulate(osc, &OscPars::L, osc.pars().L, numpoints, pass++, numpasses);
+    if(worker.hasNew()) return true;
+    Result& res = worker.resultSlot();
+    res.pars = osc.pars();
+    res.numPoints = histogram.numPoints();
+    res.width = histogram.getWidth();
+    res.height = histogram.getHeight();
+    histogram.toneMap(res.rgba);
+    worker.publish();
+    if(pass == numpasses) worker.finish();
+    return true;
+  } // HeatmapWorker::step()
+
+  public:
+  HeatmapWorker(const size_t numpoints = 10000000, const int width = 512, const size_t numpasses = 16):
+    histogram(width), numpoints(numpoints), numpasses(numpasses), pass(numpasses),
+    worker("heatmap", [this] { return step(); }) {}
+
+  // Restart the sweep for new parameters.
+  void post(const OscPars& pars) { worker.post(pars); }
+
+  // Whether the image for the newest parameters is still filling in.
+  bool busy() const { return worker.busy(); }
+
+  // Take the newest image, if there is one since the last call. Never blocks.
+  bool poll(Result& result) { return worker.poll(result); }
+}; // class HeatmapWorker
+
+} // namespace neutosc
+
+#endif
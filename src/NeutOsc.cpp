@@ -0,0 +1,9 @@
+#include "NeutOsc.h"
+
+namespace neutosc {
+
+template class BasicOscillator<float>;
+template class BasicOscillator<double>;
+template class BasicOscillator<long double>;
+
+} // namespace neutosc
@@ -3,13 +3,22 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <stdexcept>
+#include <utility>
 #include <Eigen/Dense>
 #include <unsupported/Eigen/MatrixFunctions>
 #include <complex>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <cmath>
 
-namespace neutosc {
+#include "VacuumKernel.h"
+#include "Profiler.h"
 
-std::complex<double> If(0,1);
+namespace neutosc {
 
 // A struct to hold neutrino oscillation parameters.
 struct OscPars {
@@ -31,11 +40,24 @@ struct OscPars {
   }
   bool operator!=(OscPars& other) const { return !operator==(other); }
 
-  void print(const std::string pname = "nuparameters.csv") const {
+  // Find which member a reference into this struct points to, or nullptr if it isn't one.
+  double OscPars::* member(const double& field) const {
+    static double OscPars::* const members[] = {
+      &OscPars::E, &OscPars::L, &OscPars::th12, &OscPars::th23, &OscPars::th13,
+      &OscPars::Dm21sq, &OscPars::Dm31sq, &OscPars::dCP, &OscPars::rho
+    };
+    for(double OscPars::* m : members) {
+      if(&(this->*m) == &field) return m;
+    }
+    return nullptr;
+  }
+
+  // Write the parameters to a csv file. Returns false if it couldn't be written.
+  bool print(const std::string pname = "nuparameters.csv") const {
     std::ofstream ofile(pname);
     if(!ofile.is_open()) {
       std::cout << "Could not open file " << pname << ".\n";
-      return;
+      return false;
     }
 
     // Header.
@@ -55,151 +77,775 @@ struct OscPars {
 
     std::cout << "Saving to " << pname << ".\n";
     ofile.close();
+    return !ofile.fail();
+  }
+
+  // Read parameters in the format written by print(). Parameters missing from the
+  // file keep their current values. Returns false if the file can't be opened or
+  // has a line that isn't a known parameter followed by a number.
+  bool read(const std::string pname = "nuparameters.csv") {
+    std::ifstream ifile(pname);
+    if(!ifile.is_open()) {
+      std::cerr << "Could not open file " << pname << ".\n";
+      return false;
+    }
+
+    const std::pair<const char*, double OscPars::*> fields[] = {
+      {"Energy [GeV]", &OscPars::E}, {"Travel distance [km]", &OscPars::L},
+      {"theta12 [rad]", &OscPars::th12}, {"theta23 [rad]", &OscPars::th23},
+      {"theta13 [rad]", &OscPars::th13}, {"Dm21sq [eV^2]", &OscPars::Dm21sq},
+      {"Dm31sq [eV^2]", &OscPars::Dm31sq}, {"dCP [rad]", &OscPars::dCP},
+      {"Matter density [kg/m^3]", &OscPars::rho}
+    };
+    std::string line;
+    int linenum = 0;
+    while(std::getline(ifile, line)) {
+      ++linenum;
+      if(!line.empty() && line.back() == '\r') line.pop_back();
+      const size_t comma = line.find(',');
+      if(line.empty() || line == "Parameter,Value") continue;
+      const std::string label = line.substr(0, comma);
+      double val = 0;
+      try {
+        if(comma == std::string::npos) throw std::invalid_argument(line);
+        val = std::stod(line.substr(comma+1));
+      } catch(const std::exception&) {
+        std::cerr << pname << ":" << linenum << ": expected a number.\n";
+        return false;
+      }
+      bool found = true;
+      if(label == "Initial flavour" && (val < 0 || val > 2)) {
+        std::cerr << pname << ":" << linenum << ": flavour must be 0, 1 or 2.\n";
+        return false;
+      }
+      if(label == "Initial flavour") nu = (int)val;
+      else if(label == "Antineutrino [bool]") anti = val != 0;
+      else {
+        found = false;
+        for(const auto& field : fields) {
+          if(label == field.first) {
+            this->*field.second = val;
+            found = true;
+          }
+        }
+      }
+      if(!found) {
+        std::cerr << pname << ":" << linenum << ": unknown parameter " << label << ".\n";
+        return false;
+      }
+    }
+    return true;
+  } // OscPars::read()
+};
+
+// Parameters of the columns of a Jacobian from BasicOscillator::transJacobian().
+inline const std::array<double OscPars::*, 6>& jacobianPars() {
+  static const std::array<double OscPars::*, 6> pars = {
+    &OscPars::th12, &OscPars::th23, &OscPars::th13, &OscPars::dCP, &OscPars::Dm21sq, &OscPars::Dm31sq
+  };
+  return pars;
+}
+
+// Propagation method used in matter. Vacuum always uses Oscillator::transvac().
+enum class Engine {
+  LieProduct, // Lie product formula with a fixed number of slices (approximate).
+  MatrixExp, // Pade matrix exponential per sample.
+  EigenDecomp // Diagonalised effective Hamiltonian (exact for constant density).
+};
+
+// Energy spectrum of a beam, tabulated at increasing energies and linear in between.
+struct FluxSpectrum {
+  std::vector<double> E; // In GeV.
+  std::vector<double> flux; // Any units.
+
+  // Read a csv file with the columns "E [GeV],Flux" and one energy per line. Returns
+  // false if the file can't be opened, has a malformed line, or energies that aren't
+  // positive and increasing.
+  bool read(const std::string& fname) {
+    std::ifstream ifile(fname);
+    if(!ifile.is_open()) {
+      std::cerr << "Could not open file " << fname << ".\n";
+      return false;
+    }
+    E.clear();
+    flux.clear();
+    std::string line;
+    int linenum = 0;
+    while(std::getline(ifile, line)) {
+      ++linenum;
+      if(!line.empty() && line.back() == '\r') line.pop_back();
+      if(line.empty() || line.compare(0, 6, "E [GeV") == 0) continue;
+      const size_t comma = line.find(',');
+      double e = 0, f = 0;
+      try {
+        if(comma == std::string::npos) throw std::invalid_argument(line);
+        e = std::stod(line.substr(0, comma));
+        f = std::stod(line.substr(comma+1));
+      } catch(const std::exception&) {
+        std::cerr << fname << ":" << linenum << ": expected two numbers.\n";
+        return false;
+      }
+      if(!(e > 0) || (!E.empty() && !(e > E.back())) || !(f >= 0)) {
+        std::cerr << fname << ":" << linenum << ": energies must be positive and increasing, fluxes not negative.\n";
+        return false;
+      }
+      E.push_back(e);
+      flux.push_back(f);
+    }
+    if(E.size() < 2) {
+      std::cerr << fname << ": need at least two energies.\n";
+      return false;
+    }
+    return true;
+  } // FluxSpectrum::read()
+
+  // Split the spectrum into cells no wider than maxWidth relative to their centre, with
+  // the flux interpolated linearly. Gives the centre energies, the shares of the total
+  // flux and the widths relative to the centres. Empty if there is no flux at all.
+  void cells(std::vector<double>& centres, std::vector<double>& weights, std::vector<double>& widths,
+             const double maxWidth = 0.05) const {
+    centres.clear();
+    weights.clear();
+    widths.clear();
+    double total = 0;
+    for(size_t i = 0; i+1 < E.size(); ++i) {
+      const int parts = std::max(1, (int)std::ceil((E[i+1] - E[i])/(E[i] + E[i+1])*2/maxWidth));
+      for(int part = 0; part < parts; ++part) {
+        const double a = E[i] + (E[i+1] - E[i])*part/parts, b = E[i] + (E[i+1] - E[i])*(part+1)/parts;
+        const double centre = (a + b)/2;
+        const double weight = (flux[i] + (flux[i+1] - flux[i])*(centre - E[i])/(E[i+1] - E[i]))*(b - a);
+        if(weight <= 0) continue;
+        centres.push_back(centre);
+        weights.push_back(weight);
+        widths.push_back((b - a)/centre);
+        total += weight;
+      }
+    }
+    for(double& weight : weights) weight /= total;
+  } // FluxSpectrum::cells()
+};
+
+// Shape of the energy resolution of a detector, as a spread of the reconstructed L/E.
+enum class Resolution {
+  Gaussian, // Width is the standard deviation over L/E.
+  Box // Width is the full width over L/E.
+};
+
+// Averaging of the probabilities over the energies a detector can't tell apart, and
+// optionally over the spectrum of the beam instead of the single energy E.
+struct Smearing {
+  Resolution shape = Resolution::Gaussian;
+  double width = 0; // Relative resolution, the same in L/E as in E to first order. 0 for none.
+  std::shared_ptr<const FluxSpectrum> flux; // Averaged over if set, except in sweeps of E.
+
+  bool enabled() const { return width > 0 || flux; }
+  bool operator==(const Smearing& other) const {
+    return shape == other.shape && width == other.width && flux == other.flux;
   }
+  bool operator!=(const Smearing& other) const { return !operator==(other); }
 };
 
-class Oscillator {
+// Neutrino oscillation engine. Scalar sets the precision of all internal arithmetic:
+// float for on-screen paths and large buffers, double for general use, and long
+// double for reference runs at very large L/E. Parameters are always kept in double.
+template<typename Scalar>
+class BasicOscillator {
+  public:
+  typedef std::complex<Scalar> Complex;
+  typedef Eigen::Matrix<Scalar,3,1> Vector3;
+  typedef Eigen::Matrix<Complex,3,1> Vector3c;
+  typedef Eigen::Matrix<Complex,1,3> RowVector3c;
+  typedef Eigen::Matrix<Complex,3,3> Matrix3c;
+  // Derivatives of the probabilities by the parameters of jacobianPars(), one per column.
+  typedef Eigen::Matrix<Scalar,3,6> Jacobian;
+
   private:
 	// Neutrino oscillation parameter struct.
   OscPars op;
 
   // Oscillation matrix.
-  Eigen::Matrix3cd U;
-  Eigen::Matrix3cd Ud;
+  Matrix3c U;
+  Matrix3c Ud;
   // Hamiltonian and matter potential.
-  Eigen::Matrix3cd H;
-  Eigen::Matrix3cd V;
-  Eigen::Matrix3cd Hexp;
-  Eigen::Matrix3cd Vexp;
-  // Mass difference matrix.
-  Eigen::Matrix3d Dmsq;
+  Matrix3c H;
+  Matrix3c V;
+
+  // Eigensystem of the effective matter Hamiltonian, cached per energy.
+  mutable double eigE = -1;
+  mutable Matrix3c UW; // Mixing matrix times eigenvectors.
+  mutable Matrix3c Wd; // Adjoint of the eigenvectors.
+  mutable Vector3 lambda; // Eigenvalues in km^-1.
+
+  // Derivatives of the mixing matrix by th12, th23, th13 and dCP.
+  Matrix3c dU[4];
+  // Eigensystem of the flavour Hamiltonian and its derivatives by the jacobianPars(),
+  // cached per energy and initial flavour like the matter eigensystem.
+  mutable double jacE = -1;
+  mutable int jacNu = -1;
+  mutable Matrix3c Q; // Eigenvectors in the flavour basis.
+  mutable Vector3 q; // Eigenvalues in km^-1.
+  mutable Vector3c c; // Initial state in the eigenbasis.
+  // (Qd*dH*Q)(j,k)*c(k) in column 3*j+k, one row per parameter.
+  mutable Eigen::Matrix<Scalar,6,9> dHcRe;
+  mutable Eigen::Matrix<Scalar,6,9> dHcIm;
+  // Eigensystem terms of the smeared probabilities, cached per energy and initial
+  // flavour like the derivatives.
+  mutable double smearE = -1;
+  mutable int smearNu = -1;
+  mutable Vector3 sq; // Eigenvalues in km^-1.
+  mutable Vector3 sdq; // Their derivatives by log(E).
+  mutable Vector3 sdiag; // Probabilities without the interference terms.
+  // Interference of eigenstates j < k in column j+k-1, one row per final flavour.
+  mutable Eigen::Matrix<Scalar,3,3> sRe;
+  mutable Eigen::Matrix<Scalar,3,3> sIm;
+  // Incremented by every update() so that external caches know when to refresh.
+  unsigned long version = 0;
 
   public:
-  Oscillator() {
+  BasicOscillator() {
     update();
-  } // Oscillator::Oscillator
+  } // BasicOscillator::BasicOscillator
 
   void update() {
-    const double s12 = sin(op.th12);
-    const double s23 = sin(op.th23);
-    const double s13 = sin(op.th13);
-    const double c12 = cos(op.th12);
-    const double c23 = cos(op.th23);
-    const double c13 = cos(op.th13);
+    PROFILE_SCOPE("Oscillator::update");
+    const Scalar s12 = std::sin(Scalar(op.th12));
+    const Scalar s23 = std::sin(Scalar(op.th23));
+    const Scalar s13 = std::sin(Scalar(op.th13));
+    const Scalar c12 = std::cos(Scalar(op.th12));
+    const Scalar c23 = std::cos(Scalar(op.th23));
+    const Scalar c13 = std::cos(Scalar(op.th13));
 
     // Chirality
-    const double ch = (int)op.anti * -2 + 1; // (-)1 if (anti)neutrino
+    const Scalar ch = (int)op.anti * -2 + 1; // (-)1 if (anti)neutrino
 
     // Construct mixing matrix.
-    Eigen::Matrix3cd U1;
+    Matrix3c U1;
     U1 << 1, 0, 0,
           0, c23, s23,
           0, -s23, c23;
-    Eigen::Matrix3cd U2;
-    U2 << c13, 0, s13*exp(-If*ch*op.dCP),
+    Matrix3c U2;
+    U2 << c13, 0, s13*std::polar(Scalar(1), -ch*Scalar(op.dCP)),
           0, 1, 0,
-          -s13*exp(If*ch*op.dCP), 0, c13;
-    Eigen::Matrix3cd U3;
+          -s13*std::polar(Scalar(1), ch*Scalar(op.dCP)), 0, c13;
+    Matrix3c U3;
     U3 << c12, s12, 0,
           -s12, c12, 0,
           0, 0, 1;
     U = U1*U2*U3;
     Ud = U.adjoint();
 
+    // Derivatives of the mixing matrix, one rotation at a time.
+    Matrix3c dU1;
+    dU1 << 0, 0, 0,
+           0, -s23, c23,
+           0, -c23, -s23;
+    Matrix3c dU2th;
+    dU2th << -s13, 0, c13*std::polar(Scalar(1), -ch*Scalar(op.dCP)),
+             0, 0, 0,
+             -c13*std::polar(Scalar(1), ch*Scalar(op.dCP)), 0, -s13;
+    Matrix3c dU2dCP;
+    dU2dCP << 0, 0, -ch*Complex(0,1)*s13*std::polar(Scalar(1), -ch*Scalar(op.dCP)),
+              0, 0, 0,
+              -ch*Complex(0,1)*s13*std::polar(Scalar(1), ch*Scalar(op.dCP)), 0, 0;
+    Matrix3c dU3;
+    dU3 << -s12, c12, 0,
+           -c12, -s12, 0,
+           0, 0, 0;
+    dU[0] = U1*U2*dU3;
+    dU[1] = dU1*U2*U3;
+    dU[2] = U1*dU2th*U3;
+    dU[3] = U1*dU2dCP*U3;
+
     // Hamiltonian and matter potential.
     H << 0, 0, 0,
-         0, op.Dm21sq, 0,
-         0, 0, op.Dm31sq;
-    
-    const double Gf = 4.54164e-37; // Reduced Fermi constant * (c*hbar)^2 in m^2.
-    const double Ne = op.rho/(1.672e-27)/2; // Electron number density in m^-3.
-    V(0,0) = ch*sqrt(2)*Gf*Ne * 1e3; // Multiply and convert to km^-1.
+         0, Scalar(op.Dm21sq), 0,
+         0, 0, Scalar(op.Dm31sq);
+
+    V.setZero();
+    V(0,0) = potential(op.rho);
 
-  } // Oscillator::update()
+    // Invalidate the matter eigensystem, the derivatives and the smearing terms.
+    eigE = -1;
+    jacE = -1;
+    smearE = -1;
+    ++version;
+  } // BasicOscillator::update()
 
   // Expose the neutrino oscillation parameter set to mess with it.
   OscPars& pars() { return op; }
+  const OscPars& pars() const { return op; }
+  unsigned long getVersion() const { return version; }
+  const Matrix3c& mixing() const { return U; }
+
+  // Matter potential in km^-1 for a density in kg/m^3.
+  Scalar potential(const double rho) const {
+    const Scalar ch = (int)op.anti * -2 + 1; // (-)1 if (anti)neutrino
+    const double Gf = 4.54164e-37; // Reduced Fermi constant * (c*hbar)^2 in m^2.
+    const double Ne = rho/(1.672e-27)/2; // Electron number density in m^-3.
+    return ch*std::sqrt(Scalar(2))*Scalar(Gf*Ne * 1e3); // Multiply and convert to km^-1.
+  } // BasicOscillator::potential()
+
+  // Eigensystem of the mass-basis effective Hamiltonian for any energy and density.
+  // Used to propagate through several layers of different density.
+  struct MatterEigen {
+    Matrix3c W; // Eigenvectors in the mass basis.
+    Vector3 lambda; // Eigenvalues in km^-1.
+  };
+  MatterEigen matterEigen(const double E, const double rho) const {
+    const Scalar conv = 2.534; // Conversion factor from natural to useful units.
+    // Ud*V*U with only V(0,0) non-zero, summed element by element.
+    const Scalar V0 = potential(rho);
+    Matrix3c Heff = H/Scalar(E)*conv;
+    for(int i = 0; i < 3; ++i) {
+      for(int j = 0; j < 3; ++j) Heff(i,j) += V0*std::conj(U(0,i))*U(0,j);
+    }
+    Eigen::SelfAdjointEigenSolver<Matrix3c> es(Heff);
+    return MatterEigen{es.eigenvectors(), es.eigenvalues()};
+  } // BasicOscillator::matterEigen()
 
   // General transformation function that decides between vacuum and matter oscillation.
-  Eigen::Vector3d trans(bool using_exp = false) const {
+  Vector3 trans(Engine engine = Engine::EigenDecomp) const {
     if(op.rho==0) {
       return transvac();
     }
-    return using_exp? transmatexp(): transmat();
-  } // Oscillator::trans()
+    switch(engine) {
+      case Engine::LieProduct: return transmat();
+      case Engine::MatrixExp: return transmatexp();
+      default: return transmateig();
+    }
+  } // BasicOscillator::trans()
 
   // Analytical determination of neutrino oscillation using Hamiltonian.
-  Eigen::Vector3d transvac() const {
-    Eigen::Vector3cd nu(0,0,0);
+  Vector3 transvac() const {
+    const Complex If(0,1);
+    Vector3c nu(0,0,0);
     nu(op.nu) = 1;
-    const double conv = 2.534; // Conversion factor from natural to useful units.
-    Eigen::Matrix3cd Hexp = -If*H/op.E*conv*op.L; // Temporary Hamiltonian to component-wise exponentiate.
+    const Scalar conv = 2.534; // Conversion factor from natural to useful units.
+    Matrix3c Hexp = -If*H/Scalar(op.E)*conv*Scalar(op.L); // Temporary Hamiltonian to component-wise exponentiate.
     for(int j=0; j<3; ++j) Hexp(j,j) = exp(Hexp(j,j));
     return (U*Hexp*Ud*nu).cwiseAbs2();
-  } // Oscillator::transvac()
+  } // BasicOscillator::transvac()
 
   // Analytical neutrino oscillation in matter using Hamiltonian.
-  Eigen::Vector3d transmat() const {
-    Eigen::Vector3cd nu(0,0,0);
+  Vector3 transmat() const {
+    const Complex If(0,1);
+    Vector3c nu(0,0,0);
     nu(op.nu) = 1;
     // Propagate.
-    const double conv = 2.534; // Conversion factor from natural to useful units.
+    const Scalar conv = 2.534; // Conversion factor from natural to useful units.
     const int N = 128; // Large enough N for Lie product formula.
-    Eigen::Matrix3cd Hexp = -If*H/op.E*conv*op.L/N; // Temporary Hamiltonian to component-wise exponentiate.
+    Matrix3c Hexp = -If*H/Scalar(op.E)*conv*Scalar(op.L)/Scalar(N); // Temporary Hamiltonian to component-wise exponentiate.
     for(int j=0; j<3; ++j) Hexp(j,j) = exp(Hexp(j,j));
-    Eigen::Matrix3cd Vexp = -If*V*op.L/N; // Temporary matter potential to component-wise exponentiate.
+    Matrix3c Vexp = -If*V*Scalar(op.L)/Scalar(N); // Temporary matter potential to component-wise exponentiate.
     for(int j=0; j<3; ++j) Vexp(j,j) = exp(Vexp(j,j));
     // Slow matrix power. Better than exponential...
-    Eigen::MatrixPower<Eigen::Matrix3cd> Apow(Hexp*Ud*Vexp*U);
+    // MatrixPower keeps a reference to its argument, so the product needs a name.
+    const Matrix3c A = Hexp*Ud*Vexp*U;
+    Eigen::MatrixPower<Matrix3c> Apow(A);
     return (U*Apow(N)*Ud*nu).cwiseAbs2();
-  } // Oscillator::transmat()
+  } // BasicOscillator::transmat()
 
   // Analytical neutrino oscillation in matter using Hamiltonian, using matrix exponential.
-  Eigen::Vector3d transmatexp() const {
-    Eigen::Vector3cd nu(0,0,0);
+  Vector3 transmatexp() const {
+    const Complex If(0,1);
+    Vector3c nu(0,0,0);
     nu(op.nu) = 1;
     // Propagate.
-    const double conv = 2.534; // Conversion factor from natural to useful units.
-    const Eigen::Matrix3cd Htmp = -If*H/op.E*conv*op.L; // Temporary Hamiltonian.
-    const Eigen::Matrix3cd Vtmp = -If*V*op.L; // Temporary matter potential.
+    const Scalar conv = 2.534; // Conversion factor from natural to useful units.
+    const Matrix3c Htmp = -If*H/Scalar(op.E)*conv*Scalar(op.L); // Temporary Hamiltonian.
+    const Matrix3c Vtmp = -If*V*Scalar(op.L); // Temporary matter potential.
     return (U*(Htmp+Ud*Vtmp*U).exp()*Ud*nu).cwiseAbs2();
-  } // Oscillator::transmat()
-}; // class Oscillator
-
-// Function to export neutrino oscillation data to csv.
-void exportData(const std::vector<Eigen::Vector3d>& probs, const double final) {
-  const std::string filename = "nu.csv";
-  std::ofstream ofile(filename);
-  if(!ofile.is_open()) {
-    std::cout << "Couldn't create file " << filename << ".\n";
-    return;
-  }
+  } // BasicOscillator::transmatexp()
+
+  // Diagonalise the effective Hamiltonian in the mass basis, H/E + Ud*V*U, at energy E.
+  // It is Hermitian and independent of L, so the result is kept until E or update() changes it.
+  void diagonalise(const double E) const {
+    if(E == eigE) return;
+    const Scalar conv = 2.534; // Conversion factor from natural to useful units.
+    const Matrix3c Heff = H/Scalar(E)*conv + Ud*V*U;
+    Eigen::SelfAdjointEigenSolver<Matrix3c> es(Heff);
+    lambda = es.eigenvalues();
+    UW = U*es.eigenvectors();
+    Wd = es.eigenvectors().adjoint();
+    eigE = E;
+  } // BasicOscillator::diagonalise()
+
+  // Exact neutrino oscillation in constant density matter using the diagonalised Hamiltonian.
+  Vector3 transmateig() const {
+    diagonalise(op.E);
+    Vector3c b = Wd*Ud.col(op.nu);
+    for(int j=0; j<3; ++j) b(j) *= std::polar(Scalar(1), -lambda(j)*Scalar(op.L));
+    return (UW*b).cwiseAbs2();
+  } // BasicOscillator::transmateig()
+
+  // Eigensystem of the flavour Hamiltonian at energy E and its derivatives by the
+  // jacobianPars() in that eigenbasis. In vacuum the eigenvectors are the columns of U.
+  void prepareJacobian(const double E) const {
+    if(E == jacE && op.nu == jacNu) return;
+    const Scalar conv = 2.534; // Conversion factor from natural to useful units.
+    Vector3 D;
+    for(int j = 0; j < 3; ++j) D(j) = H(j,j).real()/Scalar(E)*conv;
+    if(op.rho == 0) {
+      Q = U;
+      q = D;
+    } else {
+      diagonalise(E);
+      Q = UW;
+      q = lambda;
+    }
+    const Matrix3c Qd = Q.adjoint();
+    for(int k = 0; k < 3; ++k) c(k) = std::conj(Q(op.nu,k));
+    for(int p = 0; p < 6; ++p) {
+      Matrix3c dH;
+      if(p < 4) {
+        // The angles and phase only enter through U: dH = dU*D*Ud + U*D*dUd.
+        dH = dU[p]*D.template cast<Complex>().asDiagonal()*Ud;
+        dH += dH.adjoint().eval();
+      } else {
+        // The mass splittings only enter through D.
+        dH = U.col(p-3)*U.col(p-3).adjoint()*conv/Scalar(E);
+      }
+      const Matrix3c dHQ = Qd*dH*Q;
+      for(int j = 0; j < 3; ++j) {
+        for(int k = 0; k < 3; ++k) {
+          const Complex m = dHQ(j,k)*c(k);
+          dHcRe(p,3*j+k) = m.real();
+          dHcIm(p,3*j+k) = m.imag();
+        }
+      }
+    }
+    jacE = E;
+    jacNu = op.nu;
+  } // BasicOscillator::prepareJacobian()
+
+  // Probabilities at baseline L and their derivatives by the jacobianPars(), after
+  // prepareJacobian(). With S = Q*diag(exp(-i q L))*Qd, the derivative of S is
+  // Q*(G o Qd*dH*Q)*Qd, where G(j,k) is the divided difference of exp(-i x L) between
+  // q(j) and q(k), written with a sinc so that it stays exact for (near) degenerate q.
+  // Past the phases everything is in real arithmetic, mostly on whole Jacobian rows.
+  Vector3 propagateJacobian(const Scalar L, Jacobian& J) const {
+    Vector3c ph;
+    for(int j = 0; j < 3; ++j) ph(j) = std::polar(Scalar(1), -q(j)*L);
+    Scalar Gre[9], Gim[9]; // G(j,k) in 3*j+k.
+    for(int j = 0; j < 3; ++j) {
+      Gre[4*j] = L*ph(j).imag(); // -i L exp(-i q(j) L)
+      Gim[4*j] = -L*ph(j).real();
+      for(int k = j+1; k < 3; ++k) {
+        const Scalar x = (q(j) - q(k))*L/2;
+        Complex g;
+        if(std::abs(x) > Scalar(0.1)) {
+          g = (ph(j) - ph(k))/(q(j) - q(k));
+        } else {
+          const Scalar x2 = x*x;
+          const Scalar sinc = 1 - x2/6*(1 - x2/20*(1 - x2/42));
+          g = Complex(0, -L*sinc)*std::polar(Scalar(1), -(q(j) + q(k))*L/2);
+        }
+        Gre[3*j+k] = Gre[3*k+j] = g.real();
+        Gim[3*j+k] = Gim[3*k+j] = g.imag();
+      }
+    }
+
+    // V(p,j) = sum_k G(j,k)*(Qd*dH_p*Q)(j,k)*c(k).
+    Eigen::Matrix<Scalar,6,3> Vre, Vim;
+    for(int j = 0; j < 3; ++j) {
+      Vre.col(j).setZero();
+      Vim.col(j).setZero();
+      for(int k = 0; k < 3; ++k) {
+        const int jk = 3*j+k;
+        Vre.col(j) += Gre[jk]*dHcRe.col(jk) - Gim[jk]*dHcIm.col(jk);
+        Vim.col(j) += Gre[jk]*dHcIm.col(jk) + Gim[jk]*dHcRe.col(jk);
+      }
+    }
 
-  // Header.
-  ofile << "x,nue,numu,nutau\n";
-  // Record probabilities as function of variable x, either E or L.
-  for(double i = 0; i < probs.size(); ++i) {
-    ofile << i*(final/probs.size()) << ',' << probs[i](0) << ',' << probs[i](1) << ',' << probs[i](2) << '\n';
+    // Amplitudes a = Q*(ph o c), and dP(b)/dp = 2 Re(conj(a(b))*(Q*V(p,:))(b)).
+    Vector3 P;
+    Eigen::Matrix<Scalar,3,3> Are, Aim; // conj(a(b))*Q(b,j)
+    for(int b = 0; b < 3; ++b) {
+      Complex a = 0;
+      for(int j = 0; j < 3; ++j) a += Q(b,j)*(ph(j)*c(j));
+      P(b) = std::norm(a);
+      for(int j = 0; j < 3; ++j) {
+        const Complex m = std::conj(a)*Q(b,j);
+        Are(b,j) = m.real();
+        Aim(b,j) = m.imag();
+      }
+    }
+    J.noalias() = 2*(Are*Vre.transpose() - Aim*Vim.transpose());
+    return P;
+  } // BasicOscillator::propagateJacobian()
+
+  // Probabilities and their derivatives by th12, th23, th13, dCP, Dm21sq and Dm31sq
+  // (the columns of J, in jacobianPars() order) in one pass, exact in vacuum and in
+  // constant density matter. The eigensystem and the derivatives of the Hamiltonian are
+  // kept until E or update() changes them, so L sweeps only recompute the phases.
+  Vector3 transJacobian(Jacobian& J) const {
+    prepareJacobian(op.E);
+    return propagateJacobian(Scalar(op.L), J);
+  } // BasicOscillator::transJacobian()
+
+  // Probabilities and Jacobians for n values of one parameter, like transBatch().
+  void transJacobianBatch(const double* xs, const size_t n, double OscPars::* which,
+                          Vector3* out, Jacobian* jac) {
+    PROFILE_SCOPE("Oscillator::transJacobianBatch");
+    const double initial = op.*which;
+    const bool mixing_fixed = which == &OscPars::E || which == &OscPars::L;
+    if(which == &OscPars::L) {
+      prepareJacobian(op.E);
+      for(size_t i = 0; i < n; ++i) out[i] = propagateJacobian(Scalar(xs[i]), jac[i]);
+    } else {
+      for(size_t i = 0; i < n; ++i) {
+        op.*which = xs[i];
+        if(!mixing_fixed) update();
+        out[i] = transJacobian(jac[i]);
+      }
+    }
+    op.*which = initial;
+    if(!mixing_fixed) update();
+  } // BasicOscillator::transJacobianBatch()
+
+  // Eigensystem of the flavour Hamiltonian at energy E, split into the incoherent sum
+  // over eigenstates and the interference of each pair, with the derivatives of the
+  // eigenvalues by log(E) from the Hellmann-Feynman theorem.
+  void prepareSmearing(const double E) const {
+    if(E == smearE && op.nu == smearNu) return;
+    const Scalar conv = 2.534; // Conversion factor from natural to useful units.
+    Matrix3c Qs;
+    if(op.rho == 0) {
+      Qs = U;
+      for(int j = 0; j < 3; ++j) sq(j) = H(j,j).real()/Scalar(E)*conv;
+      sdq = -sq;
+    } else {
+      diagonalise(E);
+      Qs = UW;
+      sq = lambda;
+      for(int j = 0; j < 3; ++j) {
+        Scalar d = 0;
+        for(int m = 0; m < 3; ++m) d += std::norm(Wd(j,m))*H(m,m).real();
+        sdq(j) = -d/Scalar(E)*conv;
+      }
+    }
+    for(int b = 0; b < 3; ++b) {
+      Complex a[3]; // Amplitude of eigenstate j in final flavour b, without the phase.
+      sdiag(b) = 0;
+      for(int j = 0; j < 3; ++j) {
+        a[j] = Qs(b,j)*std::conj(Qs(op.nu,j));
+        sdiag(b) += std::norm(a[j]);
+      }
+      for(int j = 0; j < 3; ++j) {
+        for(int k = j+1; k < 3; ++k) {
+          const Complex m = a[j]*std::conj(a[k]);
+          sRe(b,j+k-1) = m.real();
+          sIm(b,j+k-1) = m.imag();
+        }
+      }
+    }
+    smearE = E;
+    smearNu = op.nu;
+  } // BasicOscillator::prepareSmearing()
+
+  static Scalar sinc(const Scalar x) {
+    return std::abs(x) < Scalar(1e-4)? 1 - x*x/6: std::sin(x)/x;
   }
-  std::cout << "Saving to " << filename << ".\n";
-  ofile.close();
-}
+
+  // Smeared probabilities at baseline L, after prepareSmearing(). The interference of
+  // eigenstates j and k goes as exp(-i phase), with a phase that moves by -spread*e for
+  // a small relative change e of L/E. Averaging over e only scales the term: by
+  // exp(-(sigma*spread)^2/2) for a Gaussian of width sigma and sinc(width*spread/2)
+  // for a box, and by the product for both. In vacuum that is exact for a spread in
+  // L/E. In matter the eigenvalues are only followed to first order in the width and
+  // the eigenvectors are taken at E, which is off by up to about 1e-2 in the crust for
+  // a 5% Gaussian (check-accuracy has the budgets).
+  Vector3 propagateSmeared(const Scalar L, const Scalar sigma, const Scalar box, const Scalar cell) const {
+    Vector3 P = sdiag;
+    for(int j = 0; j < 3; ++j) {
+      for(int k = j+1; k < 3; ++k) {
+        const Scalar phase = (sq(j) - sq(k))*L;
+        const Scalar spread = (sdq(j) - sdq(k))*L;
+        Scalar damp = 2;
+        if(sigma > 0) damp *= std::exp(-sigma*spread*sigma*spread/2);
+        if(box > 0) damp *= sinc(box*spread/2);
+        if(cell > 0) damp *= sinc(cell*spread/2);
+        const Scalar re = damp*std::cos(phase);
+        const Scalar im = damp*std::sin(phase);
+        P += sRe.col(j+k-1)*re + sIm.col(j+k-1)*im;
+      }
+    }
+    return P;
+  } // BasicOscillator::propagateSmeared()
+
+  // Energies to average over: the cells of the flux, or E alone.
+  void smearingCells(const Smearing& smearing, std::vector<double>& Es, std::vector<double>& weights,
+                     std::vector<double>& widths) const {
+    if(smearing.flux) smearing.flux->cells(Es, weights, widths);
+    if(Es.empty()) {
+      Es.assign(1, op.E);
+      weights.assign(1, 1);
+      widths.assign(1, 0);
+    }
+  } // BasicOscillator::smearingCells()
+
+  // Probabilities averaged over the energy resolution and flux of a smearing, at the
+  // current parameters.
+  Vector3 transSmeared(const Smearing& smearing) const {
+    const Scalar sigma = smearing.shape == Resolution::Gaussian? Scalar(smearing.width): 0;
+    const Scalar box = smearing.shape == Resolution::Box? Scalar(smearing.width): 0;
+    std::vector<double> Es, weights, widths;
+    smearingCells(smearing, Es, weights, widths);
+    Vector3 P = Vector3::Zero();
+    for(size_t ci = 0; ci < Es.size(); ++ci) {
+      prepareSmearing(Es[ci]);
+      P += Scalar(weights[ci])*propagateSmeared(Scalar(op.L), sigma, box, Scalar(widths[ci]));
+    }
+    return P;
+  } // BasicOscillator::transSmeared()
+
+  // Smeared probabilities for n values of one parameter, like transBatch(). A whole
+  // energy cell of the flux is done across the sweep at a time, so an L sweep costs one
+  // eigensystem per cell and a few phases per point and cell. In E sweeps the flux
+  // doesn't apply, only the resolution around each energy.
+  void transSmearedBatch(const double* xs, const size_t n, double OscPars::* which, const Smearing& smearing,
+                         Vector3* out) {
+    PROFILE_SCOPE("Oscillator::transSmearedBatch");
+    const double initial = op.*which;
+    const bool mixing_fixed = which == &OscPars::E || which == &OscPars::L;
+    const Scalar sigma = smearing.shape == Resolution::Gaussian? Scalar(smearing.width): 0;
+    const Scalar box = smearing.shape == Resolution::Box? Scalar(smearing.width): 0;
+    if(which == &OscPars::E) {
+      for(size_t i = 0; i < n; ++i) {
+        prepareSmearing(xs[i]);
+        out[i] = propagateSmeared(Scalar(op.L), sigma, box, 0);
+      }
+    } else if(which == &OscPars::L) {
+      std::vector<double> Es, weights, widths;
+      smearingCells(smearing, Es, weights, widths);
+      for(size_t i = 0; i < n; ++i) out[i].setZero();
+      for(size_t ci = 0; ci < Es.size(); ++ci) {
+        prepareSmearing(Es[ci]);
+        const Scalar weight = Scalar(weights[ci]), cell = Scalar(widths[ci]);
+        for(size_t i = 0; i < n; ++i) out[i] += weight*propagateSmeared(Scalar(xs[i]), sigma, box, cell);
+      }
+    } else {
+      for(size_t i = 0; i < n; ++i) {
+        op.*which = xs[i];
+        update();
+        out[i] = transSmeared(smearing);
+      }
+    }
+    op.*which = initial;
+    if(!mixing_fixed) update();
+  } // BasicOscillator::transSmearedBatch()
+
+  // Coefficients for the vectorised vacuum kernel for the current parameters and flavour.
+  BasicVacuumCoeffs<Scalar> vacuumCoeffs() const {
+    const Scalar conv = 2.534; // Conversion factor from natural to useful units.
+    BasicVacuumCoeffs<Scalar> c;
+    for(int b = 0; b < 3; ++b) {
+      for(int j = 0; j < 3; ++j) {
+        const Complex m = U(b,j)*Ud(j,op.nu);
+        c.re[b][j] = m.real();
+        c.im[b][j] = m.imag();
+      }
+    }
+    for(int j = 0; j < 3; ++j) c.k[j] = (H(j,j).real() - H(0,0).real())*conv;
+    return c;
+  } // BasicOscillator::vacuumCoeffs()
+
+  // Evaluate the probabilities for n values of one parameter at once.
+  // E and L don't enter the mixing matrix, so those sweeps reuse U and only
+  // recompute the phases. Any other parameter falls back to update() per sample.
+  // The parameter is restored to its original value afterwards. With a smearing
+  // enabled, goes to transSmearedBatch() instead, whatever the engine.
+  void transBatch(const double* xs, const size_t n, double OscPars::* which,
+                  Vector3* out, Engine engine = Engine::EigenDecomp, const Smearing& smearing = Smearing()) {
+    if(smearing.enabled()) {
+      transSmearedBatch(xs, n, which, smearing, out);
+      return;
+    }
+    PROFILE_SCOPE("Oscillator::transBatch");
+    const double initial = op.*which;
+    const bool mixing_fixed = which == &OscPars::E || which == &OscPars::L;
+
+    if(mixing_fixed && op.rho == 0) {
+      // Vacuum: amplitude is U * diag(exp(-i Dm^2 L/E)) * Ud * nu, of which
+      // only the diagonal phases change from sample to sample. Those go to the SIMD kernel.
+      const BasicVacuumCoeffs<Scalar> c = vacuumCoeffs();
+      const size_t chunk = 256;
+      Scalar LoverE[chunk];
+      for(size_t i0 = 0; i0 < n; i0 += chunk) {
+        const size_t m = std::min(chunk, n-i0);
+        for(size_t i = 0; i < m; ++i) {
+          LoverE[i] = which == &OscPars::L? Scalar(xs[i0+i])/Scalar(op.E): Scalar(op.L)/Scalar(xs[i0+i]);
+        }
+        Scalar* p = out[i0].data();
+        vacuumKernel(c, LoverE, m, p, p+1, p+2, 3);
+      }
+    } else if(which == &OscPars::L && engine == Engine::EigenDecomp) {
+      // Constant density L sweep: one diagonalisation, then phases only.
+      diagonalise(op.E);
+      const Vector3c b = Wd*Ud.col(op.nu);
+      for(size_t i = 0; i < n; ++i) {
+        Vector3c ph;
+        for(int j = 0; j < 3; ++j) ph(j) = std::polar(Scalar(1), -lambda(j)*Scalar(xs[i]))*b(j);
+        out[i] = (UW*ph).cwiseAbs2();
+      }
+    } else if(mixing_fixed) {
+      for(size_t i = 0; i < n; ++i) {
+        op.*which = xs[i];
+        out[i] = trans(engine);
+      }
+    } else {
+      for(size_t i = 0; i < n; ++i) {
+        op.*which = xs[i];
+        update();
+        out[i] = trans(engine);
+      }
+    }
+
+    op.*which = initial;
+    if(!mixing_fixed) update();
+  } // BasicOscillator::transBatch()
+}; // class BasicOscillator
+
+typedef BasicOscillator<float> OscillatorF;
+typedef BasicOscillator<double> Oscillator;
+typedef BasicOscillator<long double> OscillatorLD;
+
+// Instantiated once in the neutosc library.
+extern template class BasicOscillator<float>;
+extern template class BasicOscillator<double>;
+extern template class BasicOscillator<long double>;
 
 // Function to obtain a range of neutrino oscillation probabilities vs a parameter.
-std::vector<Eigen::Vector3d> oscillate(neutosc::Oscillator& osc, double& par, int numsteps = 1000, bool using_exp = false) {
+template<typename Scalar>
+std::vector<typename BasicOscillator<Scalar>::Vector3> oscillate(BasicOscillator<Scalar>& osc, double& par,
+                                                                 int numsteps = 1000,
+                                                                 Engine engine = Engine::EigenDecomp,
+                                                                 const Smearing& smearing = Smearing()) {
+  PROFILE_SCOPE("oscillate");
   const double initial = par;
   const double step = initial/numsteps;
-  std::vector<Eigen::Vector3d> result(numsteps+1);
+  std::vector<typename BasicOscillator<Scalar>::Vector3> result(numsteps+1);
+  osc.update();
+
+  // Parameters of the oscillator itself go through the batch interface.
+  double OscPars::* which = osc.pars().member(par);
+  if(which) {
+    std::vector<double> xs(result.size());
+    for(int i=0; i<xs.size(); ++i) xs[i] = i*step;
+    osc.transBatch(xs.data(), xs.size(), which, result.data(), engine, smearing);
+    return result;
+  }
+
   // Propagate.
   for(int i=0; i<result.size(); ++i) {
     par = i*step;
     osc.update();
-    result[i] = osc.trans(using_exp);
+    result[i] = smearing.enabled()? osc.transSmeared(smearing): osc.trans(engine);
   }
   // Reset to original parameter value to avoid rounding errors.
   par = initial;
   return result;
-} // std::vector<Eigen::Vector3d> oscillate()
+} // oscillate()
 
 } // namespace neutosc
 
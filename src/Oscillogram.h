@@ -0,0 +1,109 @@
+#ifndef OSCILLOGRAM_H__
+#define OSCILLOGRAM_H__
+
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include "NeutOsc.h"
+#include "EarthModel.h"
+#include "Parallel.h"
+
+namespace neutosc {
+
+// Second axis of an oscillogram. Energy is always the first.
+enum class Axis {
+  L, // Baseline in km through constant density rho.
+  CosZenith // Cosine of the zenith angle through a layered Earth.
+};
+
+// Regular grid of energies times baselines or zenith angles.
+struct OscillogramGrid {
+  int nE = 2000;
+  double Emin = 0.5; // In GeV.
+  double Emax = 8;
+  bool logE = true; // Space energies logarithmically.
+  int nY = 2000;
+  double ymin = 1; // In km or cos(zenith).
+  double ymax = 24000;
+  Axis axis = Axis::L;
+
+  double E(const int i) const {
+    const double f = nE > 1? (double)i/(nE-1): 0;
+    return logE? Emin*pow(Emax/Emin, f): Emin + f*(Emax-Emin);
+  }
+  double y(const int j) const {
+    return ymin + (nY > 1? (double)j/(nY-1): 0)*(ymax-ymin);
+  }
+  size_t size() const { return (size_t)nE*nY; }
+}; // struct OscillogramGrid
+
+// Probabilities on an oscillogram grid, stored energy-major: P(E_i, y_j) is at i*nY + j.
+// Tiles of one energy and a block of y values are spread over all cores, each worker
+// with its own copy of the oscillator. The buffer is kept between calls to compute().
+// Zenith grids reuse the trajectory of each column and the shell eigensystems of each
+// row across all tiles.
+class Oscillogram {
+  private:
+  OscillogramGrid grid;
+  DensityProfile profile;
+  std::vector<Eigen::Vector3d> probs;
+  std::vector<std::vector<Segment>> paths; // Per column, for zenith grids.
+  std::vector<EarthPropagator::Layers> layers; // Per row, for zenith grids.
+
+  public:
+  // Number of y values per tile.
+  int tileY = 256;
+
+  Oscillogram(const OscillogramGrid& grid, const DensityProfile& profile = DensityProfile::prem()):
+    grid(grid), profile(profile), probs(grid.size()) {
+    if(grid.axis == Axis::CosZenith) {
+      paths.resize(grid.nY);
+      for(int j = 0; j < grid.nY; ++j) paths[j] = trajectory(profile, grid.y(j));
+      layers.resize(grid.nE);
+    }
+  }
+
+  const OscillogramGrid& getGrid() const { return grid; }
+  const std::vector<Eigen::Vector3d>& data() const { return probs; }
+  const Eigen::Vector3d& operator()(const int i, const int j) const { return probs[(size_t)i*grid.nY + j]; }
+
+  // Fill the grid for the oscillator's parameters and initial flavour.
+  void compute(const Oscillator& osc, const Engine engine = Engine::EigenDecomp,
+               const unsigned workers = numWorkers()) {
+    if(grid.axis == Axis::CosZenith) {
+      // The shell eigensystems of every energy first, once per row.
+      parallelFor(grid.nE, 1, [&](const unsigned, const size_t i0, const size_t i1) {
+        for(size_t i = i0; i < i1; ++i) EarthPropagator::layers(osc, profile, grid.E(i), layers[i]);
+      }, workers);
+    }
+
+    const int tilesPerRow = (grid.nY + tileY - 1)/tileY;
+    std::vector<Oscillator> oscs(workers, osc);
+    std::vector<std::vector<double>> ys(workers);
+
+    parallelFor((size_t)grid.nE*tilesPerRow, 1, [&](const unsigned wi, const size_t t0, const size_t t1) {
+      for(size_t t = t0; t < t1; ++t) {
+        const int i = t/tilesPerRow;
+        const int j0 = (t%tilesPerRow)*tileY;
+        const int nj = std::min(tileY, grid.nY - j0);
+        Eigen::Vector3d* out = probs.data() + (size_t)i*grid.nY + j0;
+
+        if(grid.axis == Axis::L) {
+          ys[wi].resize(nj);
+          for(int j = 0; j < nj; ++j) ys[wi][j] = grid.y(j0+j);
+          Oscillator& wosc = oscs[wi];
+          wosc.pars().E = grid.E(i);
+          wosc.transBatch(ys[wi].data(), nj, &OscPars::L, out, engine);
+        } else {
+          for(int j = 0; j < nj; ++j) out[j] = EarthPropagator::trans(osc, layers[i], paths[j0+j]);
+        }
+      }
+    }, workers);
+  } // Oscillogram::compute()
+}; // class Oscillogram
+
+} // namespace neutosc
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PARALLEL_H__
+#define PARALLEL_H__
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+namespace neutosc {
+
+// Number of worker threads to use by default: one per core.
+inline unsigned numWorkers() {
+  const unsigned n = std::thread::hardware_concurrency();
+  return n > 0? n: 1;
+}
+
+// Run fn(worker, begin, end) over [0, n) in chunks of the given size. Workers pull
+// the next chunk from a shared counter, so uneven chunks balance out. The calling
+// thread acts as worker 0, and worker indices are below 'workers' so that callers
+// can keep per-worker state in a plain vector.
+template<typename F>
+void parallelFor(const size_t n, const size_t chunk, F fn, unsigned workers = numWorkers()) {
+  const size_t numchunks = (n + chunk - 1)/chunk;
+  workers = std::max(1u, (unsigned)std::min<size_t>(workers, numchunks));
+  std::atomic<size_t> next(0);
+  auto work = [&](const unsigned worker) {
+    for(size_t ci = next++; ci < numchunks; ci = next++) {
+      fn(worker, ci*chunk, std::min(n, (ci+1)*chunk));
+    }
+  };
+  std::vector<std::thread> threads;
+  for(unsigned wi = 1; wi < workers; ++wi) threads.emplace_back(work, wi);
+  work(0);
+  for(std::thread& thread : threads) thread.join();
+} // parallelFor()
+
+} // namespace neutosc
+
+#endif
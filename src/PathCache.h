@@ -0,0 +1,178 @@
+#ifndef PATHCACHE_H__
+#define PATHCACHE_H__
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "NeutOsc.h"
+
+namespace neutosc {
+
+// Everything a computed path depends on. Unlike OscPars::operator==, every field
+// counts, and doubles are compared bit for bit so that equal keys always hash equally.
+struct PathKey {
+  OscPars pars;
+  double OscPars::* which = &OscPars::L; // Parameter swept from 0 to its value.
+  int numsteps = 0;
+  Engine engine = Engine::EigenDecomp;
+  double tolerance = 0; // Adaptive sampling tolerance, or 0 for even steps.
+  Smearing smearing; // Its flux counts by identity.
+  bool zenith = false; // Swept over cos(zenith) from -1 to 1 through the Earth instead.
+
+  PathKey() {}
+  PathKey(const OscPars& pars, double OscPars::* which, const int numsteps,
+          const Engine engine = Engine::EigenDecomp, const double tolerance = 0,
+          const Smearing& smearing = Smearing()):
+    pars(pars), which(which), numsteps(numsteps), engine(engine), tolerance(tolerance), smearing(smearing) {}
+
+  // The doubles of OscPars, the tolerance and the resolution, in a fixed order.
+  static const int numDoubles = 11;
+  void doubles(double* out) const {
+    const double vals[numDoubles] = {pars.E, pars.L, pars.th12, pars.th23, pars.th13,
+                                     pars.Dm21sq, pars.Dm31sq, pars.dCP, pars.rho, tolerance, smearing.width};
+    std::memcpy(out, vals, sizeof(vals));
+  }
+
+  bool operator==(const PathKey& other) const {
+    double a[numDoubles], b[numDoubles];
+    doubles(a);
+    other.doubles(b);
+    return std::memcmp(a, b, sizeof(a)) == 0 && pars.nu == other.pars.nu &&
+           pars.anti == other.pars.anti && which == other.which &&
+           numsteps == other.numsteps && engine == other.engine &&
+           smearing.shape == other.smearing.shape && smearing.flux == other.smearing.flux &&
+           zenith == other.zenith;
+  }
+  bool operator!=(const PathKey& other) const { return !operator==(other); }
+}; // struct PathKey
+
+struct PathKeyHash {
+  size_t operator()(const PathKey& key) const {
+    // FNV-1a over the bits of every field.
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](const uint64_t val) {
+      for(int byte = 0; byte < 8; ++byte) {
+        h ^= (val >> (8*byte)) & 0xff;
+        h *= 1099511628211ull;
+      }
+    };
+    double vals[PathKey::numDoubles];
+    key.doubles(vals);
+    for(const double v : vals) {
+      uint64_t bits;
+      std::memcpy(&bits, &v, sizeof(bits));
+      mix(bits);
+    }
+    mix((uint64_t)key.pars.nu | (uint64_t)key.pars.anti << 8 | (uint64_t)key.engine << 16 |
+        (uint64_t)key.zenith << 24);
+    mix((uint64_t)key.numsteps | (uint64_t)key.smearing.shape << 32);
+    mix((uint64_t)(uintptr_t)key.smearing.flux.get());
+    // Which parameter is swept, by its offset in OscPars.
+    static const OscPars probe;
+    mix(key.which? (uint64_t)((const char*)&(probe.*key.which) - (const char*)&probe): ~0ull);
+    return (size_t)h;
+  }
+}; // struct PathKeyHash
+
+// Least recently used cache of computed paths, bounded by the bytes the paths take up.
+// Paths are handed out as shared pointers, so an evicted path stays valid for as long
+// as someone still draws it. Not thread safe: use it from one thread.
+template<typename Path>
+class PathCache {
+  private:
+  struct Entry {
+    PathKey key;
+    std::shared_ptr<const Path> path;
+    size_t bytes;
+  };
+  std::list<Entry> entries; // Most recently used first.
+  std::unordered_map<PathKey, typename std::list<Entry>::iterator, PathKeyHash> index;
+  size_t capacity;
+  size_t bytes = 0;
+
+  // Counters.
+  unsigned long hits = 0;
+  unsigned long misses = 0;
+  unsigned long evictions = 0;
+
+  static size_t pathBytes(const Path& path) {
+    return sizeof(Entry) + path.size()*sizeof(typename Path::value_type);
+  }
+
+  void evict() {
+    while(bytes > capacity && !entries.empty()) {
+      bytes -= entries.back().bytes;
+      index.erase(entries.back().key);
+      entries.pop_back();
+      ++evictions;
+    }
+  }
+
+  public:
+  PathCache(const size_t capacity): capacity(capacity) {}
+
+  // Cached path for a key, or nullptr. Counts as a hit or a miss.
+  std::shared_ptr<const Path> get(const PathKey& key) {
+    const auto it = index.find(key);
+    if(it == index.end()) {
+      ++misses;
+      return nullptr;
+    }
+    ++hits;
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->path;
+  } // PathCache::get()
+
+  // Whether a key is cached, without counting or touching it.
+  bool contains(const PathKey& key) const { return index.count(key) > 0; }
+
+  // Store a path, replacing any path with the same key, and return it.
+  std::shared_ptr<const Path> put(const PathKey& key, Path path) {
+    const auto it = index.find(key);
+    if(it != index.end()) {
+      bytes -= it->second->bytes;
+      entries.erase(it->second);
+      index.erase(it);
+    }
+    const size_t size = pathBytes(path);
+    std::shared_ptr<const Path> ptr = std::make_shared<const Path>(std::move(path));
+    entries.push_front(Entry{key, ptr, size});
+    index[key] = entries.begin();
+    bytes += size;
+    evict();
+    return ptr;
+  } // PathCache::put()
+
+  // Cached path for a key, or compute() stored and returned.
+  template<typename F>
+  std::shared_ptr<const Path> get(const PathKey& key, F compute) {
+    std::shared_ptr<const Path> path = get(key);
+    return path? path: put(key, compute());
+  }
+
+  void clear() {
+    entries.clear();
+    index.clear();
+    bytes = 0;
+  }
+  void setCapacity(const size_t newcapacity) {
+    capacity = newcapacity;
+    evict();
+  }
+
+  size_t size() const { return entries.size(); }
+  size_t numBytes() const { return bytes; }
+  size_t getCapacity() const { return capacity; }
+  unsigned long numHits() const { return hits; }
+  unsigned long numMisses() const { return misses; }
+  unsigned long numEvictions() const { return evictions; }
+  double hitRate() const { return hits + misses > 0? (double)hits/(hits + misses): 0; }
+}; // class PathCache
+
+} // namespace neutosc
+
+#endif
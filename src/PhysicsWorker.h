@@ -0,0 +1,239 @@
+#ifndef PHYSICSWORKER_H__
+#define PHYSICSWORKER_H__
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <Eigen/Dense>
+
+#include "NeutOsc.h"
+#include "PathCache.h"
+#include "AdaptiveSampler.h"
+#include "EarthModel.h"
+#include "TripleBuffer.h"
+
+namespace neutosc {
+
+// A thread of its own behind two latest-value mailboxes: the render loop posts
+// requests and polls results, and never waits for the work itself. The thread calls
+// step() until it returns false, then sleeps until the next request comes in.
+// Requests are published under the lock, so the thread can't miss one between
+// checking for it and going to sleep.
+//
+// Owners keep it as their last member: it starts the thread once everything step()
+// uses is constructed, and joins it before any of that is destroyed.
+template<typename Request, typename Result>
+class BackgroundWorker {
+  private:
+  struct Slot {
+    Request request;
+    unsigned long seq = 0;
+  };
+  TripleBuffer<Slot> requests;
+  TripleBuffer<Result> results;
+
+  std::mutex mutex; // Only used to sleep while there's nothing to do.
+  std::condition_variable cv;
+  std::atomic<bool> quit;
+  std::atomic<unsigned long> posted; // Sequence number of the newest request,
+  std::atomic<unsigned long> finished; // and of the newest one whose work is all published.
+
+  const char* name; // Of the thread, in the profiler.
+  const std::function<bool()> step;
+  std::thread thread;
+
+  void run() {
+    PROFILE_THREAD(name);
+    while(!quit) {
+      if(step()) continue;
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this] { return quit || requests.hasNew(); });
+    }
+  } // BackgroundWorker::run()
+
+  public:
+  BackgroundWorker(const char* name, std::function<bool()> step):
+    quit(false), posted(0), finished(0), name(name), step(std::move(step)) {
+    thread = std::thread(&BackgroundWorker::run, this);
+  }
+
+  ~BackgroundWorker() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    cv.notify_one();
+    thread.join();
+  }
+
+  BackgroundWorker(const BackgroundWorker&) = delete;
+  BackgroundWorker& operator=(const BackgroundWorker&) = delete;
+
+  // Render loop side. Posting only waits for the thread to be between two checks of
+  // its mailbox, polling never waits.
+  void post(const Request& request) {
+    Slot& slot = requests.writeSlot();
+    slot.request = request;
+    slot.seq = ++posted;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      requests.publish();
+    }
+    cv.notify_one();
+  } // BackgroundWorker::post()
+
+  bool poll(Result& result) {
+    if(!results.update()) return false;
+    std::swap(result, results.readSlot());
+    return true;
+  }
+
+  // Whether the work for the newest request is still to come.
+  bool busy() const { return finished != posted; }
+
+  // Thread side, for step(): take the newest request if there is one since the last
+  // update(), look at it with request(), publish results, and finish() it once done.
+  bool update() { return requests.update(); }
+  const Request& request() { return requests.readSlot().request; }
+  bool hasNew() const { return requests.hasNew(); }
+  bool stopping() const { return quit; }
+  Result& resultSlot() { return results.writeSlot(); }
+  void publish() { results.publish(); }
+  void finish() { finished = requests.readSlot().seq; }
+}; // class BackgroundWorker
+
+// How an animated parameter moves from one frame to the next.
+struct Animation {
+  double OscPars::* which = nullptr; // Not animating if null.
+  std::function<double(double)> next;
+};
+
+// Computes the on-screen path on its own thread, so that the render loop never waits
+// for the physics. The render loop posts the parameters it wants and picks up whatever
+// path was finished last. While animating, the next few frames are computed ahead into
+// the path cache, so that they are ready by the time the animation gets there.
+class PhysicsWorker {
+  public:
+  typedef std::vector<Eigen::Vector3f> Path;
+
+  struct Request {
+    OscPars pars;
+    Animation animation;
+    Smearing smearing;
+    bool zenith; // Vs cos(zenith) through the Earth instead of vs L.
+  };
+  struct Result {
+    PathKey key;
+    std::shared_ptr<const Path> path;
+  };
+
+  private:
+  const int numsteps; // Points per path, less one. A budget if sampling adaptively.
+  const int lookahead; // Frames computed ahead while animating.
+  const Engine engine;
+  const double tolerance; // Adaptive sampling tolerance, or 0 for even steps.
+
+  // Owned by the worker thread.
+  OscillatorF osc;
+  Oscillator earthOsc; // Zenith paths are propagated in double precision.
+  EarthPropagator earth;
+  PathCache<Path> cache;
+  std::atomic<unsigned long> hits;
+  std::atomic<unsigned long> misses;
+  PathKey published;
+  bool haspublished = false;
+
+  BackgroundWorker<Request, Result> worker;
+
+  std::shared_ptr<const Path> path(const PathKey& key) {
+    std::shared_ptr<const Path> p = cache.get(key, [this, &key] {
+      PROFILE_SCOPE("PhysicsWorker::path");
+      if(key.zenith) return zenithPath(key);
+      osc.pars() = key.pars;
+      if(key.tolerance <= 0) {
+        return oscillate(osc, osc.pars().*key.which, key.numsteps, key.engine, key.smearing);
+      }
+      AdaptiveOptions opts;
+      opts.tolerance = key.tolerance;
+      opts.maxPoints = key.numsteps + 1;
+      return oscillateAdaptive(osc, osc.pars().*key.which, opts, key.engine, key.smearing);
+    });
+    hits = cache.numHits();
+    misses = cache.numMisses();
+    return p;
+  } // PhysicsWorker::path()
+
+  // Probabilities vs cos(zenith) from -1 to 1 through the Earth, at the key's energy.
+  Path zenithPath(const PathKey& key) {
+    earthOsc.pars() = key.pars;
+    earthOsc.update();
+    std::vector<double> cosz(key.numsteps + 1);
+    for(size_t i = 0; i < cosz.size(); ++i) cosz[i] = -1 + 2.*i/key.numsteps;
+    std::vector<Eigen::Vector3d> probs(cosz.size());
+    earth.zenithBatch(cosz.data(), cosz.size(), probs.data());
+    Path path(probs.size());
+    for(size_t i = 0; i < probs.size(); ++i) path[i] = probs[i].cast<float>();
+    return path;
+  } // PhysicsWorker::zenithPath()
+
+  bool step() {
+    if(!worker.update()) return false;
+    const Request req = worker.request();
+
+    // The requested frame first.
+    PathKey key(req.pars, &OscPars::L, numsteps, engine, tolerance, req.smearing);
+    key.zenith = req.zenith;
+    if(!haspublished || key != published) {
+      Result& res = worker.resultSlot();
+      res.key = key;
+      res.path = path(key);
+      worker.publish();
+      published = key;
+      haspublished = true;
+    }
+    worker.finish();
+
+    // Then the frames the animation will ask for next, until a new request comes in.
+    if(req.animation.which && req.animation.next) {
+      PathKey ahead = key;
+      for(int fi = 0; fi < lookahead && !worker.stopping() && !worker.hasNew(); ++fi) {
+        ahead.pars.*req.animation.which = req.animation.next(ahead.pars.*req.animation.which);
+        if(!cache.contains(ahead)) path(ahead);
+      }
+    }
+    return false;
+  } // PhysicsWorker::step()
+
+  public:
+  PhysicsWorker(const int numsteps, const int lookahead = 8, const size_t cachebytes = 32 << 20,
+                const Engine engine = Engine::EigenDecomp, const double tolerance = 0):
+    numsteps(numsteps), lookahead(lookahead), engine(engine), tolerance(tolerance), earth(earthOsc), cache(cachebytes),
+    hits(0), misses(0), worker("physics", [this] { return step(); }) {}
+
+  // Ask for the path of a parameter set, smeared over energy if enabled, or for its
+  // zenith scan through the Earth.
+  void post(const OscPars& pars, const Animation& animation = Animation(), const Smearing& smearing = Smearing(),
+            const bool zenith = false) {
+    worker.post(Request{pars, animation, smearing, zenith});
+  }
+
+  // Take the newest finished path, if there is one since the last call.
+  bool poll(Result& result) { return worker.poll(result); }
+
+  // Whether the path for the newest request is still to come. Once this is false, the
+  // path is published, unless it was the same as the one before.
+  bool busy() const { return worker.busy(); }
+
+  // Path cache counters.
+  unsigned long numHits() const { return hits; }
+  unsigned long numMisses() const { return misses; }
+}; // class PhysicsWorker
+
+} // namespace neutosc
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef PROFILER_H__
+#define PROFILER_H__
+
+// Scoped timers for the stages of a frame and of the worker threads, collected per
+// thread and dumped as a Chrome trace (chrome://tracing or ui.perfetto.dev). Only
+// compiled in with EIGENNEUT_PROFILE defined (cmake -DEIGENNEUT_PROFILE=ON); without
+// it the macros below expand to nothing.
+//
+//   PROFILE_SCOPE("name");   time the rest of the enclosing block
+//   PROFILE_THREAD("name");  name the calling thread in the trace
+//   PROFILE_FRAME_START();   mark the start of a frame on the render thread
+//   PROFILE_FRAME();         mark the end of a frame on the render thread
+
+#ifdef EIGENNEUT_PROFILE
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "AllocCounter.h"
+
+namespace neutosc {
+
+class Profiler {
+  public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Event {
+    const char* name; // A string literal.
+    uint64_t start; // In ns since the profiler started.
+    uint64_t duration;
+    uint64_t allocs;
+    uint32_t thread;
+  };
+
+  // Totals of one stage over one second.
+  struct Stage {
+    const char* name;
+    uint32_t thread;
+    size_t calls = 0;
+    double totalMs = 0;
+    double maxMs = 0;
+    uint64_t allocs = 0;
+  };
+
+  private:
+  // Events of one thread, in a ring that keeps the newest eventsPerThread of them,
+  // and running per-stage totals of the current second and of the one before.
+  struct ThreadLog {
+    std::mutex mutex;
+    std::vector<Event> events;
+    size_t next = 0;
+    uint32_t id = 0;
+    std::string name;
+    uint64_t second = 0; // Of the profiler's clock, that current is for.
+    std::vector<Stage> current;
+    std::vector<Stage> previous;
+  };
+  static const size_t eventsPerThread = 1 << 15;
+  static const size_t numFrameTimes = 240;
+
+  Clock::time_point epoch;
+  mutable std::mutex mutex; // Guards threads and the frame times.
+  std::vector<std::unique_ptr<ThreadLog>> threads; // Never shrinks, so logs outlive their threads.
+  std::vector<double> frameTimes; // In ms, a ring of the newest numFrameTimes.
+  size_t nextFrame = 0;
+  uint64_t lastFrame = 0;
+  uint64_t frameBegin = 0; // Set by frameStart(), 0 if not since the last frame.
+
+  Profiler(): epoch(Clock::now()) {}
+
+  ThreadLog& log() {
+    thread_local ThreadLog* mine = nullptr;
+    if(!mine) {
+      std::lock_guard<std::mutex> lock(mutex);
+      threads.emplace_back(new ThreadLog);
+      mine = threads.back().get();
+      mine->id = threads.size() - 1;
+      mine->name = "thread " + std::to_string(mine->id);
+      mine->events.reserve(eventsPerThread);
+    }
+    return *mine;
+  }
+
+  public:
+  static Profiler& get() {
+    static Profiler profiler;
+    return profiler;
+  }
+
+  uint64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+  }
+
+  void setThreadName(const char* name) {
+    ThreadLog& l = log();
+    std::lock_guard<std::mutex> lock(l.mutex);
+    l.name = name;
+  }
+
+  void record(const char* name, const uint64_t start, const uint64_t end, const uint64_t allocs) {
+    ThreadLog& l = log();
+    std::lock_guard<std::mutex> lock(l.mutex);
+    const Event event{name, start, end - start, allocs, l.id};
+    if(l.events.size() < eventsPerThread) {
+      l.events.push_back(event);
+    } else {
+      l.events[l.next] = event;
+    }
+    l.next = (l.next + 1)%eventsPerThread;
+
+    // Totals by the second the event ended in.
+    const uint64_t second = end/1000000000;
+    if(second != l.second) {
+      if(second == l.second + 1) {
+        std::swap(l.previous, l.current);
+      } else {
+        l.previous.clear();
+      }
+      l.current.clear();
+      l.second = second;
+    }
+    auto it = std::find_if(l.current.begin(), l.current.end(), [name](const Stage& s) {
+      return s.name == name || std::strcmp(s.name, name) == 0;
+    });
+    if(it == l.current.end()) {
+      l.current.push_back(Stage());
+      it = l.current.end() - 1;
+      it->name = name;
+      it->thread = l.id;
+    }
+    ++it->calls;
+    it->totalMs += event.duration*1e-6;
+    it->maxMs = std::max(it->maxMs, event.duration*1e-6);
+    it->allocs += allocs;
+  } // Profiler::record()
+
+  // Start the current frame on the render thread, after any sleep waiting for input.
+  void frameStart() { frameBegin = now(); }
+
+  // End the current frame on the render thread, timing it from frameStart(), or from
+  // the end of the last one if it wasn't called.
+  void frame() {
+    const uint64_t t = now();
+    const uint64_t begin = frameBegin > 0? frameBegin: lastFrame;
+    if(begin > 0) {
+      record("frame", begin, t, 0);
+      std::lock_guard<std::mutex> lock(mutex);
+      if(frameTimes.size() < numFrameTimes) {
+        frameTimes.push_back((t - begin)*1e-6);
+      } else {
+        frameTimes[nextFrame] = (t - begin)*1e-6;
+      }
+      nextFrame = (nextFrame + 1)%numFrameTimes;
+    }
+    lastFrame = t;
+    frameBegin = 0;
+  } // Profiler::frame()
+
+  // Newest frame times in ms, oldest first.
+  std::vector<double> frames() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<double> result(frameTimes.size());
+    for(size_t i = 0; i < frameTimes.size(); ++i) result[i] = frameTimes[(nextFrame + i)%frameTimes.size()];
+    return result;
+  }
+
+  // Every recorded event, ordered by start time.
+  std::vector<Event> events() const {
+    std::vector<Event> result;
+    std::lock_guard<std::mutex> lock(mutex);
+    for(const std::unique_ptr<ThreadLog>& l : threads) {
+      std::lock_guard<std::mutex> loglock(l->mutex);
+      result.insert(result.end(), l->events.begin(), l->events.end());
+    }
+    std::sort(result.begin(), result.end(), [](const Event& a, const Event& b) { return a.start < b.start; });
+    return result;
+  } // Profiler::events()
+
+  // Per-stage totals of the events that ended in the last whole second, by thread.
+  // Kept up to date as events are recorded, so this only copies a few of them.
+  std::vector<Stage> stages() const {
+    const uint64_t second = now()/1000000000;
+    std::vector<Stage> result;
+    std::lock_guard<std::mutex> lock(mutex);
+    for(const std::unique_ptr<ThreadLog>& l : threads) {
+      std::lock_guard<std::mutex> loglock(l->mutex);
+      if(l->second == second) {
+        result.insert(result.end(), l->previous.begin(), l->previous.end());
+      } else if(l->second + 1 == second) {
+        result.insert(result.end(), l->current.begin(), l->current.end());
+      }
+    }
+    return result;
+  } // Profiler::stages()
+
+  std::string threadName(const uint32_t id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(id >= threads.size()) return "";
+    std::lock_guard<std::mutex> loglock(threads[id]->mutex);
+    return threads[id]->name;
+  }
+
+  // Write all recorded events in the Chrome trace event format.
+  bool writeTrace(const std::string& filename) const {
+    const std::vector<Event> all = events();
+    std::ofstream ofile(filename);
+    if(!ofile.is_open()) return false;
+    ofile << std::fixed << std::setprecision(3); // Times in us, to the ns.
+    ofile << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    size_t numthreads = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      numthreads = threads.size();
+    }
+    for(uint32_t ti = 0; ti < numthreads; ++ti) {
+      ofile << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ti
+            << ", \"args\": {\"name\": \"" << threadName(ti) << "\"}},\n";
+    }
+    for(size_t ei = 0; ei < all.size(); ++ei) {
+      const Event& e = all[ei];
+      ofile << "  {\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+            << ", \"ts\": " << e.start*1e-3 << ", \"dur\": " << e.duration*1e-3
+            << ", \"args\": {\"allocs\": " << e.allocs << "}}" << (ei+1 < all.size()? ",\n": "\n");
+    }
+    ofile << "]}\n";
+    return ofile.good();
+  } // Profiler::writeTrace()
+}; // class Profiler
+
+// Records the time and allocations from its construction to the end of its scope.
+class ScopedTimer {
+  private:
+  const char* name;
+  uint64_t start;
+  uint64_t allocs;
+
+  public:
+  ScopedTimer(const char* name): name(name), start(Profiler::get().now()), allocs(threadAllocs) {}
+  ~ScopedTimer() { Profiler::get().record(name, start, Profiler::get().now(), threadAllocs - allocs); }
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+}; // class ScopedTimer
+
+} // namespace neutosc
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) neutosc::ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_THREAD(name) neutosc::Profiler::get().setThreadName(name)
+#define PROFILE_FRAME_START() neutosc::Profiler::get().frameStart()
+#define PROFILE_FRAME() neutosc::Profiler::get().frame()
+
+#else
+
+#define PROFILE_SCOPE(name) do {} while(0)
+#define PROFILE_THREAD(name) do {} while(0)
+#define PROFILE_FRAME_START() do {} while(0)
+#define PROFILE_FRAME() do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <SFML/Graphics.hpp>
+
+#include "Profiler.h"
+#include "Resources.h"
+
+#ifdef EIGENNEUT_PROFILE
+
+// Overlay with the time per frame of every profiled stage over the last second, and a
+// histogram of recent frame times. The text is only rebuilt a few times a second.
+class ProfilerHud {
+  private:
+  sf::RenderWindow& window;
+  sf::Text text;
+  sf::RectangleShape background;
+  sf::VertexArray bars;
+  sf::Clock refresh;
+  bool visible = false;
+
+  static const int numBins = 25; // Frame time bins of binMs, the last one open ended.
+  static constexpr double binMs = 2;
+  static constexpr float histWidth = 300;
+  static constexpr float histHeight = 80;
+
+  void rebuild() {
+    const neutosc::Profiler& profiler = neutosc::Profiler::get();
+    std::vector<double> frames = profiler.frames();
+    std::vector<neutosc::Profiler::Stage> stages = profiler.stages();
+    std::sort(stages.begin(), stages.end(), [](const neutosc::Profiler::Stage& a, const neutosc::Profiler::Stage& b) {
+      return a.thread != b.thread? a.thread < b.thread: a.totalMs > b.totalMs;
+    });
+    size_t framesInWindow = 0;
+    for(const neutosc::Profiler::Stage& s : stages) {
+      if(std::string(s.name) == "frame") framesInWindow = s.calls;
+    }
+    const double perframe = 1./std::max<size_t>(1, framesInWindow);
+
+    std::ostringstream str;
+    str << std::fixed << std::setprecision(2);
+    std::sort(frames.begin(), frames.end());
+    if(!frames.empty()) {
+      str << "frame  p50 " << frames[frames.size()/2] << " ms  p99 " << frames[frames.size()*99/100]
+          << " ms  max " << frames.back() << " ms\n";
+    }
+    str << "stage: ms/frame, max ms, calls/frame, allocs/frame\n";
+    for(const neutosc::Profiler::Stage& s : stages) {
+      str << profiler.threadName(s.thread) << " " << s.name << ": " << s.totalMs*perframe << ", "
+          << s.maxMs << ", " << s.calls*perframe << ", " << s.allocs*perframe << "\n";
+    }
+    text.setString(str.str());
+
+    // Histogram of the recent frame times.
+    std::vector<int> counts(numBins, 0);
+    for(const double ms : frames) ++counts[std::min(numBins-1, (int)(ms/binMs))];
+    const int maxcount = std::max(1, *std::max_element(counts.begin(), counts.end()));
+    const sf::FloatRect bounds = text.getGlobalBounds();
+    const sf::Vector2f origin(bounds.left, bounds.top + bounds.height + 10 + histHeight);
+    const float barw = histWidth/numBins;
+    for(int bi = 0; bi < numBins; ++bi) {
+      const float h = histHeight*counts[bi]/maxcount;
+      const sf::Color colour = bi*binMs < 1000/60. ? sf::Color::White: sf::Color(255, 96, 96);
+      sf::Vertex* quad = &bars[4*bi];
+      quad[0] = sf::Vertex(origin + sf::Vector2f(bi*barw, 0), colour);
+      quad[1] = sf::Vertex(origin + sf::Vector2f((bi+1)*barw - 1, 0), colour);
+      quad[2] = sf::Vertex(origin + sf::Vector2f((bi+1)*barw - 1, -h), colour);
+      quad[3] = sf::Vertex(origin + sf::Vector2f(bi*barw, -h), colour);
+    }
+    background.setPosition(bounds.left - 10, bounds.top - 10);
+    background.setSize(sf::Vector2f(std::max(bounds.width, histWidth) + 20, bounds.height + histHeight + 30));
+  } // ProfilerHud::rebuild()
+
+  public:
+  ProfilerHud(sf::RenderWindow& window, const Resources& resources): window(window), bars(sf::Quads, 4*numBins) {
+    text.setFont(resources.font());
+    text.setCharacterSize(14);
+    text.setFillColor(sf::Color::White);
+    background.setFillColor(sf::Color(0, 0, 0, 200));
+  }
+
+  void toggle() { visible = !visible; }
+
+  void draw() {
+    if(!visible) return;
+    if(refresh.getElapsedTime().asSeconds() > 0.25) {
+      text.setPosition(20, window.getSize().y*0.55);
+      rebuild();
+      refresh.restart();
+    }
+    window.draw(background);
+    window.draw(text);
+    window.draw(bars);
+  }
+
+  // Write everything recorded so far as a Chrome trace.
+  void dump(const std::string& filename) {
+    if(neutosc::Profiler::get().writeTrace(filename)) {
+      std::cout << "Saving trace to " << filename << ".\n";
+    } else {
+      std::cout << "Couldn't write trace " << filename << ".\n";
+    }
+  }
+}; // class ProfilerHud
+
+#endif
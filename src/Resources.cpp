@@ -0,0 +1,104 @@
+#include "Resources.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+
+#include "Profiler.h"
+
+const std::vector<std::string>& Resources::labelNames() {
+  static const std::vector<std::string> names = {
+    "nu_e.png", "nu_mu.png", "nu_tau.png", "bar_nu_e.png", "bar_nu_mu.png", "bar_nu_tau.png",
+    "theta_12.png", "theta_23.png", "theta_13.png", "delta_CP.png",
+    "Delta_m_21^2.png", "Delta_m_31^2.png", "Delta_m_32^2.png", "rho.png", "L.png", "E.png"};
+  return names;
+}
+
+std::string Resources::findDirectory(const std::string& exe) {
+  std::vector<std::string> candidates;
+  if(const char* env = std::getenv("EIGENNEUT_TEXTURES")) candidates.push_back(env);
+  const size_t slash = exe.find_last_of('/');
+  if(slash != std::string::npos) {
+    const std::string exedir = exe.substr(0, slash);
+    candidates.push_back(exedir + "/textures");
+    candidates.push_back(exedir + "/../textures");
+    candidates.push_back(exedir + "/../share/eigenneut/textures");
+  }
+#ifdef EIGENNEUT_TEXTURE_DIR
+  candidates.push_back(EIGENNEUT_TEXTURE_DIR);
+#endif
+#ifdef EIGENNEUT_INSTALL_TEXTURE_DIR
+  candidates.push_back(EIGENNEUT_INSTALL_TEXTURE_DIR);
+#endif
+  candidates.push_back("../textures");
+  candidates.push_back("textures");
+
+  for(const std::string& candidate : candidates) {
+    if(std::ifstream(candidate + "/Roboto-Regular.ttf").good()) return candidate;
+  }
+  std::cout << "Couldn't find the textures directory, set EIGENNEUT_TEXTURES to it.\n";
+  return "../textures";
+} // Resources::findDirectory()
+
+Resources::Resources(const std::string& exe): dir(findDirectory(exe)) {
+  PROFILE_SCOPE("Resources::Resources");
+  if(!labelFont.loadFromFile(path("Roboto-Regular.ttf"))) {
+    std::cout << "Couldn't load font.\n";
+  }
+  buildAtlas(labelNames());
+} // Resources::Resources()
+
+// Pack the label images into rows of an atlas, tallest first, with a gap between them
+// so that neighbours can't bleed into each other when scaled.
+void Resources::buildAtlas(const std::vector<std::string>& names) {
+  const unsigned gap = 2;
+  std::vector<sf::Image> images(names.size());
+  std::vector<size_t> order;
+  unsigned widest = 0;
+  for(size_t ni = 0; ni < names.size(); ++ni) {
+    if(!images[ni].loadFromFile(path(names[ni]))) {
+      std::cout << "Couldn't load texture " << names[ni] << ".\n";
+      continue;
+    }
+    widest = std::max(widest, images[ni].getSize().x);
+    order.push_back(ni);
+  }
+  std::sort(order.begin(), order.end(), [&images](const size_t a, const size_t b) {
+    return images[a].getSize().y > images[b].getSize().y;
+  });
+
+  const unsigned width = std::min(sf::Texture::getMaximumSize(), std::max(2048u, widest + gap));
+  unsigned x = 0, y = 0, rowheight = 0;
+  for(const size_t ni : order) {
+    const sf::Vector2u size = images[ni].getSize();
+    if(x + size.x > width) {
+      x = 0;
+      y += rowheight + gap;
+      rowheight = 0;
+    }
+    rects[names[ni]] = sf::IntRect(x, y, size.x, size.y);
+    x += size.x + gap;
+    rowheight = std::max(rowheight, size.y);
+  }
+
+  sf::Image packed;
+  packed.create(width, std::max(1u, y + rowheight), sf::Color(0, 0, 0, 0));
+  for(const size_t ni : order) {
+    const sf::IntRect& r = rects[names[ni]];
+    packed.copy(images[ni], r.left, r.top);
+  }
+  if(!labelAtlas.loadFromImage(packed)) {
+    std::cout << "Couldn't create the label atlas.\n";
+    rects.clear();
+  }
+} // Resources::buildAtlas()
+
+sf::IntRect Resources::rect(const std::string& name) const {
+  const auto it = rects.find(name);
+  return it == rects.end()? sf::IntRect(): it->second;
+}
+
+sf::Sprite Resources::sprite(const std::string& name) const {
+  return sf::Sprite(labelAtlas, rect(name));
+}
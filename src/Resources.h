@@ -0,0 +1,46 @@
+#ifndef RESOURCES_H__
+#define RESOURCES_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <SFML/Graphics.hpp>
+
+// Fonts and textures of the viewer, each loaded once and shared. The label images are
+// packed into one atlas texture, so a sprite is only a rectangle of it and all labels
+// can go out in a single draw. Owned by main() and outliving everything that draws,
+// which only keeps references and sprites into it.
+class Resources {
+  private:
+  std::string dir;
+  sf::Font labelFont;
+  sf::Texture labelAtlas;
+  std::map<std::string, sf::IntRect> rects;
+
+  // Directory with the assets, searched for in order: $EIGENNEUT_TEXTURES, textures/ or
+  // ../textures/ next to the executable and share/eigenneut/textures of its prefix,
+  // the source tree and install prefix it was built for, then the working directory.
+  static std::string findDirectory(const std::string& exe);
+  void buildAtlas(const std::vector<std::string>& names);
+
+  public:
+  // Label images packed into the atlas.
+  static const std::vector<std::string>& labelNames();
+
+  // exe is argv[0], to find the assets next to the executable.
+  Resources(const std::string& exe = "");
+  Resources(const Resources&) = delete;
+  Resources& operator=(const Resources&) = delete;
+
+  const std::string& directory() const { return dir; }
+  std::string path(const std::string& name) const { return dir + "/" + name; }
+
+  const sf::Font& font() const { return labelFont; }
+  const sf::Texture& atlas() const { return labelAtlas; }
+  // Rectangle of a label in the atlas, empty if it couldn't be loaded.
+  sf::IntRect rect(const std::string& name) const;
+  // Sprite of a label, drawing from the atlas.
+  sf::Sprite sprite(const std::string& name) const;
+}; // class Resources
+
+#endif
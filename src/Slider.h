@@ -3,6 +3,10 @@
 #include <SFML/Graphics.hpp>
 #include <SFML/OpenGL.hpp>
 #include <Eigen/Dense>
+#include <functional>
+#include <cmath>
+
+#include "Resources.h"
 
 char sfKeyToChar(const sf::Keyboard::Key& key) {
   switch (key) {
@@ -41,16 +45,14 @@ class Slider {
   sf::CircleShape slidercirc;
   sf::RectangleShape sliderline;
   std::vector<sf::RectangleShape> snaplines;
-  // Textures and sprites for labels.
-  sf::Texture labeltex;
+  // Label, a sprite of the shared atlas, drawn by the control panel with the others.
   sf::Sprite labelsprite;
   // Text field.
-  sf::Font font;
   sf::Text text;
 
   public:
-  Slider(double& variable, std::string texname): val(variable), pos(-1, -1),
-         slidercirc(20,20), sliderline(sf::Vector2f(width,2)) {
+  Slider(double& variable, const Resources& resources, const std::string& texname): val(variable),
+         pos(-1, -1), slidercirc(20,20), sliderline(sf::Vector2f(width,2)) {
     // Slider button.
     slidercirc.setFillColor(sf::Color::White);
     slidercirc.setOrigin(slidercirc.getRadius(), slidercirc.getRadius());
@@ -58,13 +60,10 @@ class Slider {
     sliderline.setOrigin(sliderline.getGlobalBounds().width/2, sliderline.getGlobalBounds().height/2);
 
     // Label.
-    labeltex.loadFromFile("../textures/"+texname);
-    labelsprite.setTexture(labeltex);
+    labelsprite = resources.sprite(texname);
 
     // Text field.
-    if(!font.loadFromFile("../textures/Roboto-Regular.ttf")) {
-      std::cout << "Couldn't load font.\n";
-    }
+    text.setFont(resources.font());
     text.setString(std::to_string(val));
     text.setFillColor(sf::Color::White);
   }
@@ -82,7 +81,6 @@ class Slider {
     slidercirc.setPosition(slpos.x - slw/2 + (val-min)/(max-min) * slw, slpos.y);
     labelsprite.setPosition(slpos.x - slw/2*1.15 - labelsprite.getGlobalBounds().width,
                             slpos.y - labelsprite.getGlobalBounds().height/2);
-    text.setFont(font);
     text.setPosition(slpos.x + slw/2 * 1.1, slpos.y - text.getGlobalBounds().height);
     for(int si = 0; si < snaplines.size(); ++si) {
       const double minx = slpos.x - slw/2;
@@ -117,12 +115,22 @@ class Slider {
     for(int si = 0; si < snapvals.size(); ++si) {
       window.draw(snaplines[si]);
     }
-    labelsprite.setTexture(labeltex);
-    window.draw(labelsprite);
-    text.setFont(font);
     window.draw(text);
   }
 
+  // Append the label as two triangles with atlas coordinates, to be drawn with the
+  // labels of the other sliders.
+  void appendLabel(std::vector<sf::Vertex>& triangles) const {
+    const sf::IntRect r = labelsprite.getTextureRect();
+    const sf::Transform& tf = labelsprite.getTransform();
+    const sf::Vertex corners[4] = {
+      sf::Vertex(tf.transformPoint(0, 0), sf::Vector2f(r.left, r.top)),
+      sf::Vertex(tf.transformPoint(r.width, 0), sf::Vector2f(r.left + r.width, r.top)),
+      sf::Vertex(tf.transformPoint(r.width, r.height), sf::Vector2f(r.left + r.width, r.top + r.height)),
+      sf::Vertex(tf.transformPoint(0, r.height), sf::Vector2f(r.left, r.top + r.height))};
+    for(const int ci : {0, 1, 2, 0, 2, 3}) triangles.push_back(corners[ci]);
+  }
+
   bool setActive(Eigen::Vector2d mouse_pos) {
     const Eigen::Vector2d sliderpos(slidercirc.getPosition().x, slidercirc.getPosition().y);
     if((mouse_pos - sliderpos).norm() < 20) active = true;
@@ -143,8 +151,11 @@ class Slider {
       const double svx = (sv-min)/(max-min) * (maxx-minx) + minx;
       if(std::abs(newx-svx) < 10) newx = svx;
     }
+    // Only report a drag if the value actually moved.
+    const double newval = (newx-minx)/(maxx-minx) * (max-min) + min;
+    if(newval == val) return false;
     slidercirc.setPosition(newx, slidercirc.getPosition().y);
-    val = (newx-minx)/(maxx-minx) * (max-min) + min;
+    val = newval;
     text.setString(std::to_string(val));
     return true;
   }
@@ -201,8 +212,21 @@ class Slider {
     text.setString(std::to_string(val));
   }
 
+  // Value after one animation step from v, wrapping around like update() does.
+  static double animated(double v, const double min, const double max, const bool loop) {
+    v += (max-min)/400;
+    if(loop && v > max) v -= std::floor(v/(max-min))*(max-min);
+    return v;
+  }
+  // The animation step of this slider, for use away from the slider itself.
+  std::function<double(double)> animationStep() const {
+    const double mn = min, mx = max;
+    const bool lp = loop;
+    return [mn, mx, lp](const double v) { return animated(v, mn, mx, lp); };
+  }
+
   void animate() {
-    val += (max-min)/400;
+    val = animated(val, min, max, loop);
     update();
   }
 
@@ -0,0 +1,47 @@
+#ifndef TRIPLEBUFFER_H__
+#define TRIPLEBUFFER_H__
+
+#include <atomic>
+
+namespace neutosc {
+
+// Lock-free latest-value mailbox between one writer thread and one reader thread.
+// The writer fills its own slot and swaps it with the middle one; the reader swaps its
+// slot with the middle one when that holds something new. Neither side ever waits,
+// and values the reader didn't get to in time are simply replaced.
+template<typename T>
+class TripleBuffer {
+  private:
+  T slots[3];
+  // Index of the middle slot, plus fresh if it holds a value the reader hasn't taken.
+  static const unsigned fresh = 4;
+  std::atomic<unsigned> middle;
+  unsigned back = 1; // Writer's slot.
+  unsigned front = 2; // Reader's slot.
+
+  public:
+  TripleBuffer(): middle(0) {}
+
+  // Writer side: fill writeSlot(), then publish() it.
+  T& writeSlot() { return slots[back]; }
+  void publish() {
+    back = middle.exchange(back | fresh, std::memory_order_acq_rel) & 3;
+  }
+  void write(const T& val) {
+    writeSlot() = val;
+    publish();
+  }
+
+  // Reader side: take the newest value if there is one, then look at readSlot().
+  bool update() {
+    if(!(middle.load(std::memory_order_relaxed) & fresh)) return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+    return true;
+  }
+  T& readSlot() { return slots[front]; }
+  bool hasNew() const { return middle.load(std::memory_order_relaxed) & fresh; }
+}; // class TripleBuffer
+
+} // namespace neutosc
+
+#endif
@@ -0,0 +1,377 @@
+#include "VacuumKernel.h"
+#include <cmath>
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VACUUMKERNEL_X86
+#include <immintrin.h>
+#endif
+
+namespace neutosc {
+
+namespace {
+
+// Scalar fallbacks, also used for the tails of the SIMD loops.
+void vacuumScalar(const VacuumCoeffs& c, const double* x, const size_t n,
+                  double* pe, double* pmu, double* ptau, const size_t stride) {
+  vacuumKernel<double>(c, x, n, pe, pmu, ptau, stride);
+}
+void vacuumScalarF(const VacuumCoeffsF& c, const float* x, const size_t n,
+                   float* pe, float* pmu, float* ptau, const size_t stride) {
+  vacuumKernel<float>(c, x, n, pe, pmu, ptau, stride);
+}
+
+#ifdef VACUUMKERNEL_X86
+
+// Cody-Waite split of pi/2 and the Cephes minimax polynomials for sin and cos on [-pi/4, pi/4].
+const double DP1 = 1.57079625129699707031;
+const double DP2 = 7.54978941586159635336e-8;
+const double DP3 = 5.39030285815811905290e-15;
+const double TWO_OVER_PI = 0.63661977236758134308;
+const double ROUND_MAGIC = 6755399441055744.0; // 1.5*2^52, rounds to integer when added.
+const double SINCOF[6] = {1.58962301576546568060e-10, -2.50507477628578072866e-8,
+                          2.75573136213857245213e-6, -1.98412698295895385996e-4,
+                          8.33333333332211858878e-3, -1.66666666666666307295e-1};
+const double COSCOF[6] = {-1.13585365213876817300e-11, 2.08757008419747316778e-9,
+                          -2.75573141792967388112e-7, 2.48015872888517045348e-5,
+                          -1.38888888888730564116e-3, 4.16666666666665929218e-2};
+
+__attribute__((target("avx2,fma")))
+inline void sincos4(const __m256d x, __m256d& s, __m256d& c) {
+  // Reduce to r in [-pi/4, pi/4] and quadrant q.
+  const __m256d magic = _mm256_set1_pd(ROUND_MAGIC);
+  const __m256d t = _mm256_fmadd_pd(x, _mm256_set1_pd(TWO_OVER_PI), magic);
+  const __m256d q = _mm256_sub_pd(t, magic);
+  const __m256i qi = _mm256_castpd_si256(t);
+  __m256d r = _mm256_fnmadd_pd(q, _mm256_set1_pd(DP1), x);
+  r = _mm256_fnmadd_pd(q, _mm256_set1_pd(DP2), r);
+  r = _mm256_fnmadd_pd(q, _mm256_set1_pd(DP3), r);
+  const __m256d z = _mm256_mul_pd(r, r);
+
+  __m256d ps = _mm256_set1_pd(SINCOF[0]);
+  __m256d pc = _mm256_set1_pd(COSCOF[0]);
+  for(int i = 1; i < 6; ++i) {
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(SINCOF[i]));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(COSCOF[i]));
+  }
+  const __m256d sr = _mm256_fmadd_pd(_mm256_mul_pd(r, z), ps, r);
+  const __m256d cr = _mm256_fmadd_pd(_mm256_mul_pd(z, z), pc,
+                                     _mm256_fnmadd_pd(_mm256_set1_pd(0.5), z, _mm256_set1_pd(1)));
+
+  // Odd quadrants swap sin and cos, and the sign bits follow from q and q+1.
+  const __m256i one = _mm256_set1_epi64x(1);
+  const __m256i two = _mm256_set1_epi64x(2);
+  const __m256d swap = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(qi, one), one));
+  const __m256i ssign = _mm256_slli_epi64(_mm256_and_si256(qi, two), 62);
+  const __m256i csign = _mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(qi, one), two), 62);
+  s = _mm256_xor_pd(_mm256_blendv_pd(sr, cr, swap), _mm256_castsi256_pd(ssign));
+  c = _mm256_xor_pd(_mm256_blendv_pd(cr, sr, swap), _mm256_castsi256_pd(csign));
+}
+
+__attribute__((target("avx2,fma")))
+void vacuumAVX2(const VacuumCoeffs& c, const double* x, const size_t n,
+                double* pe, double* pmu, double* ptau, const size_t stride) {
+  double* const outs[3] = {pe, pmu, ptau};
+  const __m256d k1 = _mm256_set1_pd(-c.k[1]);
+  const __m256d k2 = _mm256_set1_pd(-c.k[2]);
+  size_t i = 0;
+  for(; i + 4 <= n; i += 4) {
+    const __m256d xv = _mm256_loadu_pd(x + i);
+    __m256d s1, c1, s2, c2;
+    sincos4(_mm256_mul_pd(k1, xv), s1, c1);
+    sincos4(_mm256_mul_pd(k2, xv), s2, c2);
+    for(int b = 0; b < 3; ++b) {
+      __m256d re = _mm256_set1_pd(c.re[b][0]);
+      re = _mm256_fmadd_pd(_mm256_set1_pd(c.re[b][1]), c1, re);
+      re = _mm256_fnmadd_pd(_mm256_set1_pd(c.im[b][1]), s1, re);
+      re = _mm256_fmadd_pd(_mm256_set1_pd(c.re[b][2]), c2, re);
+      re = _mm256_fnmadd_pd(_mm256_set1_pd(c.im[b][2]), s2, re);
+      __m256d im = _mm256_set1_pd(c.im[b][0]);
+      im = _mm256_fmadd_pd(_mm256_set1_pd(c.re[b][1]), s1, im);
+      im = _mm256_fmadd_pd(_mm256_set1_pd(c.im[b][1]), c1, im);
+      im = _mm256_fmadd_pd(_mm256_set1_pd(c.re[b][2]), s2, im);
+      im = _mm256_fmadd_pd(_mm256_set1_pd(c.im[b][2]), c2, im);
+      const __m256d p = _mm256_fmadd_pd(re, re, _mm256_mul_pd(im, im));
+      if(stride == 1) {
+        _mm256_storeu_pd(outs[b] + i, p);
+      } else {
+        alignas(32) double tmp[4];
+        _mm256_store_pd(tmp, p);
+        for(int l = 0; l < 4; ++l) outs[b][(i+l)*stride] = tmp[l];
+      }
+    }
+  }
+  vacuumScalar(c, x + i, n - i, pe + i*stride, pmu + i*stride, ptau + i*stride, stride);
+}
+
+__attribute__((target("avx512f")))
+inline void sincos8(const __m512d x, __m512d& s, __m512d& c) {
+  const __m512d magic = _mm512_set1_pd(ROUND_MAGIC);
+  const __m512d t = _mm512_fmadd_pd(x, _mm512_set1_pd(TWO_OVER_PI), magic);
+  const __m512d q = _mm512_sub_pd(t, magic);
+  const __m512i qi = _mm512_castpd_si512(t);
+  __m512d r = _mm512_fnmadd_pd(q, _mm512_set1_pd(DP1), x);
+  r = _mm512_fnmadd_pd(q, _mm512_set1_pd(DP2), r);
+  r = _mm512_fnmadd_pd(q, _mm512_set1_pd(DP3), r);
+  const __m512d z = _mm512_mul_pd(r, r);
+
+  __m512d ps = _mm512_set1_pd(SINCOF[0]);
+  __m512d pc = _mm512_set1_pd(COSCOF[0]);
+  for(int i = 1; i < 6; ++i) {
+    ps = _mm512_fmadd_pd(ps, z, _mm512_set1_pd(SINCOF[i]));
+    pc = _mm512_fmadd_pd(pc, z, _mm512_set1_pd(COSCOF[i]));
+  }
+  const __m512d sr = _mm512_fmadd_pd(_mm512_mul_pd(r, z), ps, r);
+  const __m512d cr = _mm512_fmadd_pd(_mm512_mul_pd(z, z), pc,
+                                     _mm512_fnmadd_pd(_mm512_set1_pd(0.5), z, _mm512_set1_pd(1)));
+
+  const __m512i one = _mm512_set1_epi64(1);
+  const __m512i two = _mm512_set1_epi64(2);
+  const __mmask8 swap = _mm512_test_epi64_mask(qi, one);
+  const __m512i ssign = _mm512_slli_epi64(_mm512_and_si512(qi, two), 62);
+  const __m512i csign = _mm512_slli_epi64(_mm512_and_si512(_mm512_add_epi64(qi, one), two), 62);
+  s = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(_mm512_mask_blend_pd(swap, sr, cr)), ssign));
+  c = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(_mm512_mask_blend_pd(swap, cr, sr)), csign));
+}
+
+__attribute__((target("avx512f")))
+void vacuumAVX512(const VacuumCoeffs& c, const double* x, const size_t n,
+                  double* pe, double* pmu, double* ptau, const size_t stride) {
+  double* const outs[3] = {pe, pmu, ptau};
+  const __m512d k1 = _mm512_set1_pd(-c.k[1]);
+  const __m512d k2 = _mm512_set1_pd(-c.k[2]);
+  const long long st = stride;
+  const __m512i idx = _mm512_set_epi64(7*st, 6*st, 5*st, 4*st, 3*st, 2*st, st, 0);
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8) {
+    const __m512d xv = _mm512_loadu_pd(x + i);
+    __m512d s1, c1, s2, c2;
+    sincos8(_mm512_mul_pd(k1, xv), s1, c1);
+    sincos8(_mm512_mul_pd(k2, xv), s2, c2);
+    for(int b = 0; b < 3; ++b) {
+      __m512d re = _mm512_set1_pd(c.re[b][0]);
+      re = _mm512_fmadd_pd(_mm512_set1_pd(c.re[b][1]), c1, re);
+      re = _mm512_fnmadd_pd(_mm512_set1_pd(c.im[b][1]), s1, re);
+      re = _mm512_fmadd_pd(_mm512_set1_pd(c.re[b][2]), c2, re);
+      re = _mm512_fnmadd_pd(_mm512_set1_pd(c.im[b][2]), s2, re);
+      __m512d im = _mm512_set1_pd(c.im[b][0]);
+      im = _mm512_fmadd_pd(_mm512_set1_pd(c.re[b][1]), s1, im);
+      im = _mm512_fmadd_pd(_mm512_set1_pd(c.im[b][1]), c1, im);
+      im = _mm512_fmadd_pd(_mm512_set1_pd(c.re[b][2]), s2, im);
+      im = _mm512_fmadd_pd(_mm512_set1_pd(c.im[b][2]), c2, im);
+      const __m512d p = _mm512_fmadd_pd(re, re, _mm512_mul_pd(im, im));
+      if(stride == 1) {
+        _mm512_storeu_pd(outs[b] + i, p);
+      } else {
+        _mm512_i64scatter_pd(outs[b] + i*stride, idx, p, 8);
+      }
+    }
+  }
+  vacuumScalar(c, x + i, n - i, pe + i*stride, pmu + i*stride, ptau + i*stride, stride);
+}
+
+// Single precision versions: the Cephes sinf and cosf polynomials with a float
+// split of pi/2. Twice as many lanes as the double versions.
+const float DP1F = 1.5703125f;
+const float DP2F = 4.837512969970703125e-4f;
+const float DP3F = 7.54978995489188216e-8f;
+const float ROUND_MAGICF = 12582912.f; // 1.5*2^23.
+// Adding ROUND_MAGICF only rounds x*2/pi to an integer below 2^22, so larger phases
+// go through the scalar code, which reduces them exactly.
+const float MAX_PHASEF = 6e6f;
+const float SINCOFF[3] = {-1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f};
+const float COSCOFF[3] = {2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f};
+
+// Largest |x| whose phases stay below MAX_PHASEF.
+float maxArgF(const VacuumCoeffsF& c) {
+  const float kmax = std::max(std::abs(c.k[1]), std::abs(c.k[2]));
+  return kmax > 0? MAX_PHASEF/kmax: HUGE_VALF;
+}
+
+__attribute__((target("avx2,fma")))
+inline void sincos8f(const __m256 x, __m256& s, __m256& c) {
+  const __m256 magic = _mm256_set1_ps(ROUND_MAGICF);
+  const __m256 t = _mm256_fmadd_ps(x, _mm256_set1_ps((float)TWO_OVER_PI), magic);
+  const __m256 q = _mm256_sub_ps(t, magic);
+  const __m256i qi = _mm256_castps_si256(t);
+  __m256 r = _mm256_fnmadd_ps(q, _mm256_set1_ps(DP1F), x);
+  r = _mm256_fnmadd_ps(q, _mm256_set1_ps(DP2F), r);
+  r = _mm256_fnmadd_ps(q, _mm256_set1_ps(DP3F), r);
+  const __m256 z = _mm256_mul_ps(r, r);
+
+  __m256 ps = _mm256_set1_ps(SINCOFF[0]);
+  __m256 pc = _mm256_set1_ps(COSCOFF[0]);
+  for(int i = 1; i < 3; ++i) {
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(SINCOFF[i]));
+    pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(COSCOFF[i]));
+  }
+  const __m256 sr = _mm256_fmadd_ps(_mm256_mul_ps(r, z), ps, r);
+  const __m256 cr = _mm256_fmadd_ps(_mm256_mul_ps(z, z), pc,
+                                    _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1)));
+
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i two = _mm256_set1_epi32(2);
+  const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(qi, one), one));
+  const __m256i ssign = _mm256_slli_epi32(_mm256_and_si256(qi, two), 30);
+  const __m256i csign = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(qi, one), two), 30);
+  s = _mm256_xor_ps(_mm256_blendv_ps(sr, cr, swap), _mm256_castsi256_ps(ssign));
+  c = _mm256_xor_ps(_mm256_blendv_ps(cr, sr, swap), _mm256_castsi256_ps(csign));
+}
+
+__attribute__((target("avx2,fma")))
+void vacuumAVX2F(const VacuumCoeffsF& c, const float* x, const size_t n,
+                 float* pe, float* pmu, float* ptau, const size_t stride) {
+  float* const outs[3] = {pe, pmu, ptau};
+  const __m256 k1 = _mm256_set1_ps(-c.k[1]);
+  const __m256 k2 = _mm256_set1_ps(-c.k[2]);
+  const __m256 xmax = _mm256_set1_ps(maxArgF(c));
+  const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8) {
+    const __m256 xv = _mm256_loadu_ps(x + i);
+    if(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_and_ps(xv, absmask), xmax, _CMP_GT_OQ))) {
+      vacuumScalarF(c, x + i, 8, pe + i*stride, pmu + i*stride, ptau + i*stride, stride);
+      continue;
+    }
+    __m256 s1, c1, s2, c2;
+    sincos8f(_mm256_mul_ps(k1, xv), s1, c1);
+    sincos8f(_mm256_mul_ps(k2, xv), s2, c2);
+    for(int b = 0; b < 3; ++b) {
+      __m256 re = _mm256_set1_ps(c.re[b][0]);
+      re = _mm256_fmadd_ps(_mm256_set1_ps(c.re[b][1]), c1, re);
+      re = _mm256_fnmadd_ps(_mm256_set1_ps(c.im[b][1]), s1, re);
+      re = _mm256_fmadd_ps(_mm256_set1_ps(c.re[b][2]), c2, re);
+      re = _mm256_fnmadd_ps(_mm256_set1_ps(c.im[b][2]), s2, re);
+      __m256 im = _mm256_set1_ps(c.im[b][0]);
+      im = _mm256_fmadd_ps(_mm256_set1_ps(c.re[b][1]), s1, im);
+      im = _mm256_fmadd_ps(_mm256_set1_ps(c.im[b][1]), c1, im);
+      im = _mm256_fmadd_ps(_mm256_set1_ps(c.re[b][2]), s2, im);
+      im = _mm256_fmadd_ps(_mm256_set1_ps(c.im[b][2]), c2, im);
+      const __m256 p = _mm256_fmadd_ps(re, re, _mm256_mul_ps(im, im));
+      if(stride == 1) {
+        _mm256_storeu_ps(outs[b] + i, p);
+      } else {
+        alignas(32) float tmp[8];
+        _mm256_store_ps(tmp, p);
+        for(int l = 0; l < 8; ++l) outs[b][(i+l)*stride] = tmp[l];
+      }
+    }
+  }
+  vacuumScalarF(c, x + i, n - i, pe + i*stride, pmu + i*stride, ptau + i*stride, stride);
+}
+
+__attribute__((target("avx512f")))
+inline void sincos16f(const __m512 x, __m512& s, __m512& c) {
+  const __m512 magic = _mm512_set1_ps(ROUND_MAGICF);
+  const __m512 t = _mm512_fmadd_ps(x, _mm512_set1_ps((float)TWO_OVER_PI), magic);
+  const __m512 q = _mm512_sub_ps(t, magic);
+  const __m512i qi = _mm512_castps_si512(t);
+  __m512 r = _mm512_fnmadd_ps(q, _mm512_set1_ps(DP1F), x);
+  r = _mm512_fnmadd_ps(q, _mm512_set1_ps(DP2F), r);
+  r = _mm512_fnmadd_ps(q, _mm512_set1_ps(DP3F), r);
+  const __m512 z = _mm512_mul_ps(r, r);
+
+  __m512 ps = _mm512_set1_ps(SINCOFF[0]);
+  __m512 pc = _mm512_set1_ps(COSCOFF[0]);
+  for(int i = 1; i < 3; ++i) {
+    ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(SINCOFF[i]));
+    pc = _mm512_fmadd_ps(pc, z, _mm512_set1_ps(COSCOFF[i]));
+  }
+  const __m512 sr = _mm512_fmadd_ps(_mm512_mul_ps(r, z), ps, r);
+  const __m512 cr = _mm512_fmadd_ps(_mm512_mul_ps(z, z), pc,
+                                    _mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, _mm512_set1_ps(1)));
+
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i two = _mm512_set1_epi32(2);
+  const __mmask16 swap = _mm512_test_epi32_mask(qi, one);
+  const __m512i ssign = _mm512_slli_epi32(_mm512_and_si512(qi, two), 30);
+  const __m512i csign = _mm512_slli_epi32(_mm512_and_si512(_mm512_add_epi32(qi, one), two), 30);
+  s = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(swap, sr, cr)), ssign));
+  c = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(swap, cr, sr)), csign));
+}
+
+__attribute__((target("avx512f")))
+void vacuumAVX512F(const VacuumCoeffsF& c, const float* x, const size_t n,
+                   float* pe, float* pmu, float* ptau, const size_t stride) {
+  float* const outs[3] = {pe, pmu, ptau};
+  const __m512 k1 = _mm512_set1_ps(-c.k[1]);
+  const __m512 k2 = _mm512_set1_ps(-c.k[2]);
+  const __m512 xmax = _mm512_set1_ps(maxArgF(c));
+  const int st = stride;
+  const __m512i idx = _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+                                         _mm512_set1_epi32(st));
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16) {
+    const __m512 xv = _mm512_loadu_ps(x + i);
+    if(_mm512_cmp_ps_mask(_mm512_abs_ps(xv), xmax, _CMP_GT_OQ)) {
+      vacuumScalarF(c, x + i, 16, pe + i*stride, pmu + i*stride, ptau + i*stride, stride);
+      continue;
+    }
+    __m512 s1, c1, s2, c2;
+    sincos16f(_mm512_mul_ps(k1, xv), s1, c1);
+    sincos16f(_mm512_mul_ps(k2, xv), s2, c2);
+    for(int b = 0; b < 3; ++b) {
+      __m512 re = _mm512_set1_ps(c.re[b][0]);
+      re = _mm512_fmadd_ps(_mm512_set1_ps(c.re[b][1]), c1, re);
+      re = _mm512_fnmadd_ps(_mm512_set1_ps(c.im[b][1]), s1, re);
+      re = _mm512_fmadd_ps(_mm512_set1_ps(c.re[b][2]), c2, re);
+      re = _mm512_fnmadd_ps(_mm512_set1_ps(c.im[b][2]), s2, re);
+      __m512 im = _mm512_set1_ps(c.im[b][0]);
+      im = _mm512_fmadd_ps(_mm512_set1_ps(c.re[b][1]), s1, im);
+      im = _mm512_fmadd_ps(_mm512_set1_ps(c.im[b][1]), c1, im);
+      im = _mm512_fmadd_ps(_mm512_set1_ps(c.re[b][2]), s2, im);
+      im = _mm512_fmadd_ps(_mm512_set1_ps(c.im[b][2]), c2, im);
+      const __m512 p = _mm512_fmadd_ps(re, re, _mm512_mul_ps(im, im));
+      if(stride == 1) {
+        _mm512_storeu_ps(outs[b] + i, p);
+      } else {
+        _mm512_i32scatter_ps(outs[b] + i*stride, idx, p, 4);
+      }
+    }
+  }
+  vacuumScalarF(c, x + i, n - i, pe + i*stride, pmu + i*stride, ptau + i*stride, stride);
+}
+
+#endif // VACUUMKERNEL_X86
+
+typedef void (*KernelFn)(const VacuumCoeffs&, const double*, size_t, double*, double*, double*, size_t);
+typedef void (*KernelFnF)(const VacuumCoeffsF&, const float*, size_t, float*, float*, float*, size_t);
+
+struct Kernel {
+  KernelFn fn;
+  KernelFnF fnf;
+  const char* name;
+};
+
+// Pick the widest implementation the CPU supports, once.
+const Kernel& kernel() {
+  static const Kernel k = []() {
+#ifdef VACUUMKERNEL_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return Kernel{vacuumAVX512, vacuumAVX512F, "avx512"};
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return Kernel{vacuumAVX2, vacuumAVX2F, "avx2"};
+    }
+#endif
+    return Kernel{vacuumScalar, vacuumScalarF, "scalar"};
+  }();
+  return k;
+}
+
+} // namespace
+
+void vacuumKernel(const VacuumCoeffs& c, const double* x, const size_t n,
+                  double* pe, double* pmu, double* ptau, const size_t stride) {
+  kernel().fn(c, x, n, pe, pmu, ptau, stride);
+} // vacuumKernel()
+
+void vacuumKernel(const VacuumCoeffsF& c, const float* x, const size_t n,
+                  float* pe, float* pmu, float* ptau, const size_t stride) {
+  kernel().fnf(c, x, n, pe, pmu, ptau, stride);
+} // vacuumKernel()
+
+const char* vacuumKernelName() {
+  return kernel().name;
+} // vacuumKernelName()
+
+} // namespace neutosc
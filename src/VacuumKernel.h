@@ -0,0 +1,53 @@
+#ifndef VACUUMKERNEL_H__
+#define VACUUMKERNEL_H__
+
+#include <cstddef>
+#include <cmath>
+
+namespace neutosc {
+
+// Vacuum amplitudes written as A_b = sum_j M(b,j) * exp(-i k_j x) with x = L/E,
+// where M(b,j) = U(b,j) * conj(U(nu,j)) and k_j = 2.534 * m_j^2 (relative to m_1).
+// Real and imaginary parts are kept apart so that the kernel can work on
+// plain floating point lanes.
+template<typename T>
+struct BasicVacuumCoeffs {
+  T re[3][3];
+  T im[3][3];
+  T k[3];
+};
+typedef BasicVacuumCoeffs<double> VacuumCoeffs;
+typedef BasicVacuumCoeffs<float> VacuumCoeffsF;
+
+// Probabilities for n values of L/E. Flavour b of sample i is written to
+// out_b[i*stride], so stride 1 gives separate columns and stride 3 with
+// consecutive pointers fills an array of Eigen::Vector3d.
+// Uses AVX-512 or AVX2 when the CPU has them and plain C++ otherwise.
+// The float version has twice as many lanes per instruction.
+void vacuumKernel(const VacuumCoeffs& c, const double* x, const size_t n,
+                  double* pe, double* pmu, double* ptau, const size_t stride = 1);
+void vacuumKernel(const VacuumCoeffsF& c, const float* x, const size_t n,
+                  float* pe, float* pmu, float* ptau, const size_t stride = 1);
+
+// Plain C++ version for any other precision, such as long double reference runs.
+template<typename T>
+void vacuumKernel(const BasicVacuumCoeffs<T>& c, const T* x, const size_t n,
+                  T* pe, T* pmu, T* ptau, const size_t stride = 1) {
+  T* const outs[3] = {pe, pmu, ptau};
+  for(size_t i = 0; i < n; ++i) {
+    const T s1 = std::sin(-c.k[1]*x[i]), c1 = std::cos(-c.k[1]*x[i]);
+    const T s2 = std::sin(-c.k[2]*x[i]), c2 = std::cos(-c.k[2]*x[i]);
+    for(int b = 0; b < 3; ++b) {
+      const T re = c.re[b][0] + c.re[b][1]*c1 - c.im[b][1]*s1 + c.re[b][2]*c2 - c.im[b][2]*s2;
+      const T im = c.im[b][0] + c.re[b][1]*s1 + c.im[b][1]*c1 + c.re[b][2]*s2 + c.im[b][2]*c2;
+      outs[b][i*stride] = re*re + im*im;
+    }
+  }
+} // vacuumKernel()
+
+// Name of the implementation picked at runtime ("avx512", "avx2" or "scalar").
+const char* vacuumKernelName();
+
+} // namespace neutosc
+
+#endif
@@ -1,22 +1,53 @@
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <memory>
+#include <future>
+#include <chrono>
 #include <SFML/Graphics.hpp>
 #include <SFML/OpenGL.hpp>
 #include <Eigen/Dense>
 
 #include "DrawUtil.h"
 #include "NeutOsc.h"
+#include "ExportQueue.h"
+#include "PhysicsWorker.h"
+#include "Ensemble.h"
+#include "Heatmap.h"
+#include "Fit.h"
+#include "Headless.h"
 #include "ControlPanel.h"
 #include "Slider.h"
+#include "Resources.h"
+#include "Profiler.h"
+#include "ProfilerHud.h"
 
-typedef std::vector<Eigen::Vector3d> NuPath;
+typedef std::vector<Eigen::Vector3f> NuPath;
 
 static const int start_w = 1500;
 static const int start_h = 1000;
 static const bool start_fullscreen = false;
+static const int path_steps = 1500; // Point budget of the on-screen path.
+static const double path_tolerance = 1e-3; // Adaptive sampling tolerance, about a pixel.
+static const int path_lookahead = 8; // Animation frames computed ahead.
+static const size_t path_cache_bytes = 32 << 20;
+static const size_t ensemble_members = 10000; // Parameter sets per uncertainty ensemble.
+static const int ensemble_steps = 500;
+static const size_t heatmap_points = 10000000; // Points per heatmap sweep.
+static const int heatmap_width = 512; // Histogram bins across the triangle.
+static const double smear_gauss_width = 0.05; // Relative resolutions of the smearing modes.
+static const double smear_box_width = 0.1;
+
+// Exports are csv, or binary columns when shift is held.
+static void setFormat(neutosc::ExportJob& job, const bool binary) {
+  job.binary = binary;
+  job.filename = binary? "nu.enb": "nu.csv";
+}
 
 int main(int argc, char *argv[]) {
+  // Batch runs on machines without a display never touch SFML.
+  if(neutosc::isHeadless(argc, argv)) return neutosc::runHeadless(argc, argv);
+
   //Get the screen size
   sf::VideoMode screenSize = sf::VideoMode::getDesktopMode();
   screenSize = sf::VideoMode(start_w, start_h, screenSize.bitsPerPixel);
@@ -37,24 +68,72 @@ int main(int argc, char *argv[]) {
   window.requestFocus();
   sf::View view = window.getDefaultView();
   
+  // Fonts and label textures, loaded once and shared by everything below.
+  const Resources resources(argv[0]);
+
   // Create ternary graph, oscillator and control panel class instances.
-  DrawUtil::TernaryGraph tgraph(window);
+  DrawUtil::TernaryGraph tgraph(window, resources);
   tgraph.setPosition(window.getSize().x/4, 0);
   tgraph.setSize(window.getSize().x/4.*3, window.getSize().y);
   neutosc::Oscillator osc;
-  ControlPanel cp(window, osc.pars());
+  ControlPanel cp(window, resources, osc.pars());
   cp.setPosition(0,0);
   cp.setSize(600,500);
 
+  // Exports run in the background on snapshots of the parameters.
+  neutosc::ExportQueue exports;
+  neutosc::ExportJob job;
+
+  // Paths are computed on a separate thread, which also caches them so that
+  // revisited states draw without recomputing.
+  neutosc::PhysicsWorker physics(path_steps, path_lookahead, path_cache_bytes,
+                                 neutosc::Engine::EigenDecomp, path_tolerance);
+  neutosc::PhysicsWorker::Result result;
+  neutosc::PathKey shown; // State of the path on screen.
+  bool showing = false;
+
+  // Uncertainty bands from an ensemble of parameter sets around the sliders' values,
+  // computed on their own thread while switched on.
+  std::unique_ptr<neutosc::EnsembleWorker> ensemble;
+  neutosc::EnsembleBands bands;
+
+  // Density heatmap of a long, finely sampled sweep, replacing the path while switched on.
+  std::unique_ptr<neutosc::HeatmapWorker> heatmap;
+  neutosc::HeatmapWorker::Result image;
+
+  // Energy smearing of the path and exports: off, a Gaussian or box resolution, or
+  // the beam spectrum in flux.csv, read when first picked.
+  neutosc::Smearing smearing;
+  std::shared_ptr<const neutosc::FluxSpectrum> flux;
+
+  // Show the path vs cos(zenith) through a PREM Earth at the slider energy, instead of vs L.
+  bool zenith = false;
+
+  // Fit of the free parameters to spectrum.csv, run in the background from the sliders'
+  // values, which it moves to the best fit when done.
+  std::future<neutosc::FitResult> fit;
+
   // Mouse input variables.
   Eigen::Vector2d mouse_pos(0,0);
   bool mouse_pressed = false;
 
+#ifdef EIGENNEUT_PROFILE
+  // Stage timings on screen, and a trace of everything recorded so far on request.
+  PROFILE_THREAD("main");
+  ProfilerHud hud(window, resources);
+#endif
+
   //Main Loop
   bool redraw = true;
+  bool idle = false; // Nothing on screen is changing, so sleep until the next event.
   while (window.isOpen()) {
     sf::Event event;
-    while (window.pollEvent(event)) {
+    bool waiting = idle;
+    PROFILE_FRAME_START();
+    while (waiting? window.waitEvent(event): window.pollEvent(event)) {
+      // Frame times don't count the sleep.
+      if(waiting) PROFILE_FRAME_START();
+      waiting = false;
       if (event.type == sf::Event::Closed) {
         window.close();
         break;
@@ -78,16 +157,25 @@ int main(int argc, char *argv[]) {
           redraw = true;
         } else if(keycode == sf::Keyboard::L) {
           // Export probabilities as function of travel distance (with 10000 steps).
-          neutosc::exportData(neutosc::oscillate(osc, osc.pars().L, 10000, true), osc.pars().L);
-          osc.pars().print();
+          job.pars = osc.pars();
+          job.which = &neutosc::OscPars::L;
+          job.smearing = smearing;
+          setFormat(job, event.key.shift);
+          exports.push(job);
         } else if(keycode == sf::Keyboard::E) {
           // Export probabilities as function of energy (with 10000 steps).
-          neutosc::exportData(neutosc::oscillate(osc, osc.pars().E, 10000, true), osc.pars().E);
-          osc.pars().print();
+          job.pars = osc.pars();
+          job.which = &neutosc::OscPars::E;
+          job.smearing = smearing;
+          setFormat(job, event.key.shift);
+          exports.push(job);
         } else if(keycode == sf::Keyboard::X) {
           // Export probabilities as function of last active variable (with 10000 steps).
-          neutosc::exportData(neutosc::oscillate(osc, cp.lastActiveVar(), 10000, true), cp.lastActiveVar());
-          osc.pars().print();
+          job.pars = osc.pars();
+          job.which = osc.pars().member(cp.lastActiveVar());
+          job.smearing = smearing;
+          setFormat(job, event.key.shift);
+          exports.push(job);
         } else if(keycode == sf::Keyboard::A) {
           // Toggle between neutrinos and antineutrinos.
           osc.pars().anti = !osc.pars().anti;
@@ -95,6 +183,77 @@ int main(int argc, char *argv[]) {
           tgraph.setAnti(osc.pars().anti);
           tgraph.updateWindow();
           redraw = true;
+        } else if(keycode == sf::Keyboard::U) {
+          // Toggle uncertainty bands.
+          if(ensemble) {
+            ensemble.reset();
+            tgraph.clearBands();
+          } else {
+            ensemble.reset(new neutosc::EnsembleWorker(ensemble_members, ensemble_steps));
+          }
+          redraw = true;
+        } else if(keycode == sf::Keyboard::H) {
+          // Toggle the density heatmap.
+          if(heatmap) {
+            heatmap.reset();
+            tgraph.clearHeatmap();
+            // Back to the newest path, which kept arriving meanwhile.
+            if(result.path) {
+              tgraph.clear();
+              tgraph.addDrawing(*result.path);
+              shown = result.key;
+              showing = true;
+            }
+          } else {
+            heatmap.reset(new neutosc::HeatmapWorker(heatmap_points, heatmap_width));
+            tgraph.clear();
+          }
+          redraw = true;
+        } else if(keycode == sf::Keyboard::P || keycode == sf::Keyboard::T) {
+#ifdef EIGENNEUT_PROFILE
+          if(keycode == sf::Keyboard::P) hud.toggle();
+          else hud.dump("trace.json");
+#else
+          std::cout << "Profiling is off. Build with -DEIGENNEUT_PROFILE=ON to turn it on.\n";
+#endif
+        } else if(keycode == sf::Keyboard::F) {
+          // Fit th23, dCP and Dm31sq to the measured spectrum.
+          neutosc::Spectrum data;
+          if(!fit.valid() && data.read("spectrum.csv")) {
+            std::cout << "Fitting " << data.bins.size() << " bins.\n";
+            fit = std::async(std::launch::async, [data](const neutosc::OscPars start) {
+              return neutosc::fitSpectrum(data, start);
+            }, osc.pars());
+          }
+        } else if(keycode == sf::Keyboard::R) {
+          // Next smearing mode. The flux one is skipped if flux.csv can't be read.
+          if(smearing.flux) {
+            smearing = neutosc::Smearing();
+          } else if(!smearing.enabled()) {
+            smearing.shape = neutosc::Resolution::Gaussian;
+            smearing.width = smear_gauss_width;
+            std::cout << "Smearing over a Gaussian resolution of " << smearing.width*100 << "%.\n";
+          } else if(smearing.shape == neutosc::Resolution::Gaussian) {
+            smearing.shape = neutosc::Resolution::Box;
+            smearing.width = smear_box_width;
+            std::cout << "Smearing over a box resolution of " << smearing.width*100 << "%.\n";
+          } else {
+            if(!flux) {
+              std::shared_ptr<neutosc::FluxSpectrum> read(new neutosc::FluxSpectrum);
+              if(read->read("flux.csv")) flux = read;
+            }
+            smearing = neutosc::Smearing();
+            smearing.flux = flux;
+            if(flux) std::cout << "Averaging over the flux in flux.csv.\n";
+          }
+          if(!smearing.enabled()) std::cout << "Smearing off.\n";
+          redraw = true;
+        } else if(keycode == sf::Keyboard::Z) {
+          // Toggle the atmospheric zenith scan through the Earth.
+          zenith = !zenith;
+          if(zenith) std::cout << "Path vs cos(zenith) from -1 to 1 through the Earth.\n";
+          else std::cout << "Path vs baseline.\n";
+          redraw = true;
         } else if(keycode == sf::Keyboard::M) {
           // Flip mass hierarchy
           osc.pars().Dm31sq *= -1;
@@ -135,18 +294,69 @@ int main(int argc, char *argv[]) {
     // Draw control panel.
     cp.draw();
 
-    // If redrawing or animating, regenerate neutrino oscillation probabilities.
+    // Move the sliders to a finished fit.
+    const bool fitting = fit.valid();
+    if(fitting && fit.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      const neutosc::FitResult best = fit.get();
+      best.print(std::cout);
+      for(double neutosc::OscPars::* which : best.free) osc.pars().*which = best.pars.*which;
+      osc.update();
+      cp.update();
+      redraw = true;
+    }
+
+    // If redrawing or animating, ask for new neutrino oscillation probabilities.
     if(redraw || cp.isAnimating()) {
-      tgraph.clear();
-      osc.update(); // Update internal mixing matrix etc from control panel.
-      tgraph.addDrawing(neutosc::oscillate(osc, osc.pars().L, 1500));
+      physics.post(osc.pars(), cp.animation(osc.pars()), smearing, zenith);
+      if(ensemble) ensemble->post(osc.pars());
+      if(heatmap) heatmap->post(osc.pars());
       redraw = false;
     }
+    // Checked before polling, so that anything finished by now gets picked up below.
+    const bool working = physics.busy() || (ensemble && ensemble->busy()) || (heatmap && heatmap->busy()) ||
+                         fitting;
+    // Show the newest finished path, unless it's already on screen.
+    if(physics.poll(result) && !heatmap && (!showing || result.key != shown)) {
+      tgraph.clear();
+      tgraph.addDrawing(*result.path);
+      shown = result.key;
+      showing = true;
+    }
+    if(ensemble && ensemble->poll(bands)) tgraph.setBands(bands.lower, bands.upper);
+    if(heatmap && heatmap->poll(image)) tgraph.setHeatmap(image.rgba, image.width, image.height);
     tgraph.draw();
 
+    // Show export progress along the bottom of the window, with a tick per queued export.
+    const bool exporting = exports.busy();
+    if(exporting) {
+      sf::RectangleShape bar(sf::Vector2f(window.getSize().x*exports.progress(), 4));
+      bar.setPosition(0, window.getSize().y-4);
+      bar.setFillColor(sf::Color::White);
+      window.draw(bar);
+      for(int ji = 1; ji < exports.numPending(); ++ji) {
+        sf::RectangleShape tick(sf::Vector2f(8, 8));
+        tick.setPosition(window.getSize().x - 12*ji, window.getSize().y-16);
+        window.draw(tick);
+      }
+    }
+
+#ifdef EIGENNEUT_PROFILE
+    hud.draw();
+#endif
+
     //Flip the screen buffer
-    window.display();
+    {
+      PROFILE_SCOPE("display");
+      window.display();
+    }
+    PROFILE_FRAME();
+
+    // Keep drawing frames only while something is moving or a result is on its way.
+    // Input wakes the loop straight away, and any event gets at least one frame. The
+    // workers are asleep too by then, so an idle viewer takes no CPU at all.
+    idle = !redraw && !cp.isAnimating() && !tgraph.isAnimating() && !working && !exporting;
   }
 
+  std::cout << "Path cache: " << physics.numHits() << " hits, " << physics.numMisses() << " misses.\n";
   return 0;
 }